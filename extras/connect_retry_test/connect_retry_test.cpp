@@ -0,0 +1,106 @@
+/**
+ * @file connect_retry_test.cpp
+ * Host side test of the connect retry policy and circuit breaker in NukiConnectRetry.h
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * Checks the bounds of the randomized backoff per retry (with the RNG returning its extremes) and
+ * walks the circuit breaker through closed, open, half open and back.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=c++17 -Iextras/connect_retry_test -Isrc extras/connect_retry_test/connect_retry_test.cpp -o connect_retry_test
+ *   ./connect_retry_test
+ *
+ */
+
+#include "NukiConnectRetry.cpp"
+#include <stdio.h>
+
+#define STALE_TIMEOUT 30000
+#define CONNECT_RETRIES 5
+
+static uint32_t nextRandom = 0;
+
+uint32_t esp_random() {
+  return nextRandom;
+}
+
+static int failures = 0;
+
+static void check(const bool condition, const char* description) {
+  printf("%s: %s\n", condition ? "ok  " : "FAIL", description);
+  if (!condition) {
+    failures++;
+  }
+}
+
+static bool delayBetween(Nuki::BackoffRetryPolicy& policy, const uint8_t retry, const uint32_t minMs, const uint32_t maxMs) {
+  nextRandom = 0;
+  uint32_t lowest = policy.getRetryDelay(retry);
+  nextRandom = UINT32_MAX;
+  uint32_t highest = policy.getRetryDelay(retry);
+  bool inRange = true;
+  for (uint32_t r = 0; r < 5000; r++) {
+    nextRandom = r * 7919;
+    uint32_t delayMs = policy.getRetryDelay(retry);
+    inRange = inRange && delayMs >= minMs && delayMs <= maxMs;
+  }
+  return lowest == minMs && highest <= maxMs && inRange;
+}
+
+static void testBackoff() {
+  Nuki::BackoffRetryPolicy policy;
+  check(delayBetween(policy, 1, 25, 50), "first retry between base / 2 and base");
+  check(delayBetween(policy, 2, 50, 100), "second retry doubled");
+  check(delayBetween(policy, 5, 400, 800), "fifth retry doubled four times");
+  check(delayBetween(policy, 6, 500, 1000), "capped at the maximum");
+  check(delayBetween(policy, 40, 500, 1000), "large retry does not overflow the shift");
+  check(delayBetween(policy, 0, 500, 1000), "retry 0 uses the maximum");
+
+  Nuki::BackoffRetryPolicy custom(100, 250);
+  check(delayBetween(custom, 2, 100, 200) && delayBetween(custom, 3, 125, 250), "custom base and maximum");
+}
+
+static void testCircuitBreaker() {
+  Nuki::ConnectCircuitBreaker breaker;
+  check(!breaker.isEnabled() && breaker.getState() == Nuki::CircuitState::Closed, "disabled and closed by default");
+
+  breaker.setEnabled(true, STALE_TIMEOUT);
+  breaker.checkStale(STALE_TIMEOUT + 1, STALE_TIMEOUT + 1);
+  breaker.setEnabled(false, STALE_TIMEOUT);
+  check(breaker.getState() == Nuki::CircuitState::Closed, "disabling closes the circuit");
+
+  breaker.setEnabled(true, STALE_TIMEOUT);
+  check(breaker.getState() == Nuki::CircuitState::Closed && breaker.getMaxAttempts(CONNECT_RETRIES) == CONNECT_RETRIES,
+        "closed circuit allows all attempts");
+  check(!breaker.checkStale(STALE_TIMEOUT + 1, 100) && breaker.getState() == Nuki::CircuitState::Closed,
+        "recent link activity keeps the circuit closed");
+  check(!breaker.checkStale(100, STALE_TIMEOUT + 1) && breaker.getState() == Nuki::CircuitState::Closed,
+        "recent advertisement keeps the circuit closed");
+  check(!breaker.advertisementReceived() && !breaker.connectSucceeded() && !breaker.connectFailed()
+        && breaker.getState() == Nuki::CircuitState::Closed, "events do not change a closed circuit");
+
+  check(breaker.checkStale(STALE_TIMEOUT + 1, STALE_TIMEOUT + 1) && breaker.getState() == Nuki::CircuitState::Open,
+        "stale lock opens the circuit");
+  check(!breaker.checkStale(STALE_TIMEOUT + 1, STALE_TIMEOUT + 1), "opening is reported once");
+  check(!breaker.connectSucceeded() && !breaker.connectFailed() && breaker.getState() == Nuki::CircuitState::Open,
+        "connect results do not change an open circuit");
+
+  check(breaker.advertisementReceived() && breaker.getState() == Nuki::CircuitState::HalfOpen,
+        "advertisement half opens the circuit");
+  check(!breaker.advertisementReceived() && breaker.getMaxAttempts(CONNECT_RETRIES) == 1,
+        "half open circuit allows a single probe");
+  check(breaker.connectFailed() && breaker.getState() == Nuki::CircuitState::Open, "failed probe reopens the circuit");
+
+  breaker.advertisementReceived();
+  check(breaker.connectSucceeded() && breaker.getState() == Nuki::CircuitState::Closed, "successful probe closes the circuit");
+}
+
+int main() {
+  testBackoff();
+  testCircuitBreaker();
+
+  printf(failures == 0 ? "OK\n" : "FAILED\n");
+  return failures == 0 ? 0 : 1;
+}
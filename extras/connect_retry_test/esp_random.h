@@ -0,0 +1,12 @@
+#pragma once
+
+/**
+ * @file esp_random.h
+ * Host side replacement of the ESP-IDF RNG header for extras/connect_retry_test, esp_random() is
+ * implemented by the test
+ *
+ */
+
+#include <stdint.h>
+
+uint32_t esp_random();
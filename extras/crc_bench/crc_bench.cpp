@@ -0,0 +1,126 @@
+/**
+ * @file crc_bench.cpp
+ * Host side verification and micro benchmark of the CRC-16/CCITT-FALSE in NukiCrc.cpp
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * Compares the table driven and the slicing-by-4 CRC with a bit-by-bit reference of the
+ * Crc16::fastCrc(data, 0, length, false, false, 0x1021, 0xffff, 0x0000, 0x8000, 0xffff) call the
+ * library used before, checks the CRC-16/CCITT-FALSE check value (0x29b1 for "123456789") and
+ * reports the ns/byte of the three implementations.
+ * NukiCrc.cpp is compiled into the bench with NUKI_CRC_SLICING_BY_4 defined, so both variants are
+ * covered whether or not the library is built with the slicing variant.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=c++17 -Isrc extras/crc_bench/crc_bench.cpp -o crc_bench
+ *   ./crc_bench
+ *
+ */
+
+#define NUKI_CRC_SLICING_BY_4
+#include "NukiCrc.cpp"
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define CHECK_VALUE 0x29b1
+#define RANDOM_BUFFERS 100000
+#define MAX_RANDOM_LEN 300
+#define BENCH_BYTES 100000000
+
+//bit-by-bit CRC as calculated by Crc16::fastCrc, length is the end index
+static uint16_t fastCrcReference(const uint8_t* data, uint8_t start, uint16_t length) {
+  unsigned int crc = 0xffff;
+  if (length == 0) {
+    return crc;
+  }
+
+  for (int i = start; i < length; i++) {
+    uint8_t c = data[i];
+    for (unsigned int j = 0x80; j > 0; j >>= 1) {
+      unsigned int bit = crc & 0x8000;
+      crc <<= 1;
+      if (c & j) {
+        bit ^= 0x8000;
+      }
+      if (bit) {
+        crc ^= 0x1021;
+      }
+    }
+  }
+  return crc & 0xffff;
+}
+
+static bool verify() {
+  const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+  uint16_t reference = fastCrcReference(check, 0, sizeof(check));
+  uint16_t table = Nuki::crc16CcittFalse(check, sizeof(check));
+  uint16_t slicing = Nuki::crc16CcittFalseSlicing4(check, sizeof(check));
+  printf("check value: reference %04x, table %04x, slicing-by-4 %04x (expected %04x)\n", reference, table, slicing, CHECK_VALUE);
+  if (reference != CHECK_VALUE || table != CHECK_VALUE || slicing != CHECK_VALUE) {
+    return false;
+  }
+
+  srand(1);
+  std::vector<uint8_t> data(MAX_RANDOM_LEN);
+  for (int n = 0; n < RANDOM_BUFFERS; n++) {
+    uint16_t len = rand() % MAX_RANDOM_LEN;
+    for (uint16_t i = 0; i < len; i++) {
+      data[i] = rand();
+    }
+
+    uint16_t expected = fastCrcReference(data.data(), 0, len);
+    if (Nuki::crc16CcittFalse(data.data(), len) != expected || Nuki::crc16CcittFalseSlicing4(data.data(), len) != expected) {
+      printf("mismatch on a buffer of %d bytes\n", len);
+      return false;
+    }
+  }
+  printf("%d random buffers of 0-%d bytes match the reference\n", RANDOM_BUFFERS, MAX_RANDOM_LEN - 1);
+  return true;
+}
+
+template <typename TCrc>
+static double nsPerByte(std::vector<uint8_t>& data, TCrc crc) {
+  const size_t iterations = BENCH_BYTES / data.size();
+  volatile uint16_t sink = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; i++) {
+    //vary the input so the compiler can not hoist the calculation out of the loop
+    data[0] = (uint8_t)i;
+    sink = sink ^ crc(data.data(), (uint16_t)data.size());
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / ((double)iterations * data.size());
+}
+
+int main() {
+  if (!verify()) {
+    printf("FAILED\n");
+    return 1;
+  }
+
+  //plain messages, a typical command and a log entry
+  const uint16_t lengths[] = {8, 32, 200};
+  printf("\n len  bitwise  table  slicing-by-4 (ns/byte)\n");
+  for (uint16_t len : lengths) {
+    std::vector<uint8_t> data(len);
+    for (uint8_t& b : data) {
+      b = rand();
+    }
+
+    double reference = nsPerByte(data, [](const uint8_t* d, uint16_t l) {
+      return fastCrcReference(d, 0, l);
+    });
+    double table = nsPerByte(data, [](const uint8_t* d, uint16_t l) {
+      return Nuki::crc16CcittFalse(d, l);
+    });
+    double slicing = nsPerByte(data, [](const uint8_t* d, uint16_t l) {
+      return Nuki::crc16CcittFalseSlicing4(d, l);
+    });
+    printf("%4d  %7.2f  %5.2f  %12.2f\n", len, reference, table, slicing);
+  }
+  return 0;
+}
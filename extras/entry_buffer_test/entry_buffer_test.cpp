@@ -0,0 +1,91 @@
+/**
+ * @file entry_buffer_test.cpp
+ * Host side test of the fixed capacity entry storage in NukiEntryBuffer.h
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * Fills the buffer beyond its capacity and checks the stored entries, the drop counter and the reuse
+ * of the allocated block after clear(). Build with -DNUKI_ENTRY_STORAGE_STATIC to test the storage
+ * embedded in the object.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=c++17 -Isrc extras/entry_buffer_test/entry_buffer_test.cpp -o entry_buffer_test
+ *   ./entry_buffer_test
+ *
+ */
+
+#include "NukiEntryBuffer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_CAPACITY 8
+
+struct __attribute__((packed)) TestEntry {
+  uint32_t index;
+  uint8_t data[5];
+};
+
+static int failures = 0;
+
+static void check(const bool condition, const char* description) {
+  printf("%s: %s\n", condition ? "ok  " : "FAIL", description);
+  if (!condition) {
+    failures++;
+  }
+}
+
+static TestEntry makeEntry(const uint32_t index) {
+  TestEntry entry;
+  entry.index = index;
+  for (size_t i = 0; i < sizeof(entry.data); i++) {
+    entry.data[i] = index + i;
+  }
+  return entry;
+}
+
+static bool entriesInOrder(const Nuki::EntryBuffer<TestEntry, TEST_CAPACITY>& buffer, const uint32_t firstIndex) {
+  uint32_t index = firstIndex;
+  for (const TestEntry& entry : buffer) {
+    TestEntry expected = makeEntry(index++);
+    if (memcmp(&entry, &expected, sizeof(entry)) != 0) {
+      return false;
+    }
+  }
+  return index - firstIndex == buffer.size();
+}
+
+int main() {
+  Nuki::EntryBuffer<TestEntry, TEST_CAPACITY> buffer;
+
+  check(buffer.size() == 0 && buffer.begin() == buffer.end(), "empty before first use");
+  check(buffer.capacity() == TEST_CAPACITY, "capacity");
+
+  bool stored = true;
+  for (uint32_t i = 0; i < TEST_CAPACITY; i++) {
+    stored = buffer.push_back(makeEntry(i)) && stored;
+  }
+  check(stored && buffer.size() == TEST_CAPACITY && buffer.getDropped() == 0, "entries up to the capacity stored");
+  check(entriesInOrder(buffer, 0), "entries stored in order");
+
+  const TestEntry* block = buffer.begin();
+  check(!buffer.push_back(makeEntry(TEST_CAPACITY)) && !buffer.push_back(makeEntry(TEST_CAPACITY + 1)), "entries beyond the capacity rejected");
+  check(buffer.size() == TEST_CAPACITY && buffer.getDropped() == 2, "entries beyond the capacity dropped and counted");
+  check(entriesInOrder(buffer, 0), "stored entries unchanged by drops");
+
+  buffer.clear();
+  check(buffer.size() == 0 && buffer.getDropped() == 0, "clear resets size and drop counter");
+
+  for (uint32_t i = 100; i < 103; i++) {
+    buffer.push_back(makeEntry(i));
+  }
+  check(buffer.begin() == block, "block reused after clear");
+  check(buffer.size() == 3 && entriesInOrder(buffer, 100), "entries of the next retrieval stored from the start");
+
+  //the default capacities of the lists
+  check(Nuki::EntryBuffer<TestEntry>().capacity() == NUKI_ENTRY_CAPACITY, "default capacity NUKI_ENTRY_CAPACITY");
+  check(NUKI_KEYPAD_ENTRY_CAPACITY >= 200 && NUKI_AUTHORIZATION_ENTRY_CAPACITY >= 200, "keypad and authorization capacity hold a full lock");
+
+  printf(failures == 0 ? "OK\n" : "FAILED\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+/**
+ * @file esp_random.h
+ * Host side replacement of the ESP-IDF RNG header for extras/nonce_test, esp_fill_random() is
+ * implemented by the test
+ *
+ */
+
+#include <stddef.h>
+
+void esp_fill_random(void* buf, size_t len);
@@ -0,0 +1,122 @@
+/**
+ * @file payload_decoder_test.cpp
+ * Host side test of the bounds checked payload decoding in NukiPayloadDecoder.h
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * Decodes short, exact and long payloads into a packed data type with trailing fields that older
+ * firmware does not send and checks the copied bytes, the zero filled tail, the size table lookup and
+ * the mismatch counters.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=c++17 -Isrc extras/payload_decoder_test/payload_decoder_test.cpp -o payload_decoder_test
+ *   ./payload_decoder_test
+ *
+ */
+
+#include "NukiPayloadDecoder.h"
+#include <stdio.h>
+
+#define CMD_STATE 0x000c
+#define CMD_ENTRY 0x0032
+#define CMD_UNKNOWN 0x00ff
+
+//shaped like the state and config types, the fields with a default value are not sent by older firmware
+struct __attribute__((packed)) TestState {
+  uint8_t state;
+  uint16_t year;
+  uint32_t counter;
+  uint8_t newField = 255;
+  uint16_t newerField = 65535;
+};
+
+struct __attribute__((packed)) TestEntry {
+  uint32_t index;
+  uint8_t data[4];
+};
+
+static constexpr Nuki::PayloadSize payloadSizes[] = {
+  Nuki::payloadSizeFrom<TestState>(CMD_STATE, offsetof(TestState, newField)),
+  Nuki::payloadSizeOf<TestEntry>(CMD_ENTRY)
+};
+
+static int failures = 0;
+
+static void check(const bool condition, const char* description) {
+  printf("%s: %s\n", condition ? "ok  " : "FAIL", description);
+  if (!condition) {
+    failures++;
+  }
+}
+
+static bool decode(TestState* target, const uint8_t* data, const uint16_t dataLen, Nuki::PayloadStats* stats) {
+  const Nuki::PayloadSize* expected = Nuki::findPayloadSize(payloadSizes, sizeof(payloadSizes) / sizeof(payloadSizes[0]), CMD_STATE);
+  return Nuki::decodePayload(target, data, dataLen, CMD_STATE, expected, stats);
+}
+
+static bool tailIsZero(const TestState& state, const size_t from) {
+  const uint8_t* bytes = (const uint8_t*)&state;
+  for (size_t i = from; i < sizeof(state); i++) {
+    if (bytes[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  uint8_t payload[sizeof(TestState) + 8];
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = 0xa0 + i;
+  }
+  Nuki::PayloadStats stats = {};
+  TestState state;
+
+  check(Nuki::findPayloadSize(payloadSizes, 2, CMD_STATE) == &payloadSizes[0], "size table lookup");
+  check(Nuki::findPayloadSize(payloadSizes, 2, CMD_UNKNOWN) == nullptr, "unknown command not in size table");
+  check(payloadSizes[0].minSize == 7 && payloadSizes[0].maxSize == sizeof(TestState), "range up to the first optional field");
+
+  //exact
+  check(decode(&state, payload, sizeof(TestState), &stats), "exact payload accepted");
+  check(memcmp(&state, payload, sizeof(TestState)) == 0, "exact payload copied completely");
+
+  //older firmware, the optional fields are missing
+  state = TestState();
+  check(decode(&state, payload, offsetof(TestState, newField), &stats), "payload without optional fields accepted");
+  check(memcmp(&state, payload, offsetof(TestState, newField)) == 0, "fields sent are copied");
+  check(tailIsZero(state, offsetof(TestState, newField)), "fields not sent are zero filled");
+
+  //truncated inside the mandatory fields
+  state = TestState();
+  check(!decode(&state, payload, 3, &stats), "short payload reported");
+  check(memcmp(&state, payload, 3) == 0 && tailIsZero(state, 3), "short payload copied and zero filled");
+  check(stats.shortPayloads == 1 && stats.lastMismatchCommand == CMD_STATE && stats.lastMismatchLen == 3, "short payload counted");
+
+  //empty
+  check(!decode(&state, payload, 0, &stats), "empty payload reported");
+  check(tailIsZero(state, 0), "empty payload zero fills the type");
+
+  //newer firmware, fields the type does not know yet
+  uint8_t guard[8];
+  memset(guard, 0x55, sizeof(guard));
+  struct __attribute__((packed)) {
+    TestState state;
+    uint8_t after[8];
+  } bounded;
+  memset(bounded.after, 0x55, sizeof(bounded.after));
+  check(!decode(&bounded.state, payload, sizeof(payload), &stats), "long payload reported");
+  check(memcmp(&bounded.state, payload, sizeof(TestState)) == 0, "long payload copied up to the size of the type");
+  check(memcmp(bounded.after, guard, sizeof(guard)) == 0, "long payload not written beyond the type");
+  check(stats.longPayloads == 1 && stats.lastMismatchLen == sizeof(payload), "long payload counted");
+
+  //no size table entry, sizeof(T) is expected
+  TestEntry entry;
+  check(Nuki::decodePayload(&entry, payload, sizeof(TestEntry), CMD_ENTRY, nullptr, &stats), "exact payload without table entry accepted");
+  check(!Nuki::decodePayload(&entry, payload, sizeof(TestEntry) - 1, CMD_ENTRY, nullptr, &stats), "short payload without table entry reported");
+
+  check(stats.decoded == 7 && stats.shortPayloads == 3, "decode counters");
+
+  printf(failures == 0 ? "OK\n" : "FAILED\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file round_trip_test.cpp
+ * Host side test of the round trip window in NukiRoundTrip.h the adaptive timeouts are derived from
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * Compares the incrementally maintained p50 / p99 against a sort of the samples in the window, while
+ * the window fills and after it wraps, and checks the clamping of the derived timeout.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=c++17 -Isrc extras/round_trip_test/round_trip_test.cpp -o round_trip_test
+ *   ./round_trip_test
+ *
+ */
+
+#include "NukiRoundTrip.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#define TEST_WINDOW 32
+
+static int failures = 0;
+
+static void check(const bool condition, const char* description) {
+  printf("%s: %s\n", condition ? "ok  " : "FAIL", description);
+  if (!condition) {
+    failures++;
+  }
+}
+
+//nearest rank percentile of the last count samples
+static uint16_t percentile(const uint16_t* history, const size_t added, const size_t count, const size_t percent) {
+  uint16_t window[TEST_WINDOW];
+  std::copy(history + added - count, history + added, window);
+  std::sort(window, window + count);
+  return window[(count * percent + 99) / 100 - 1];
+}
+
+int main() {
+  Nuki::RoundTripWindow<TEST_WINDOW> window;
+  check(window.getCount() == 0 && window.getP50() == 0 && window.getP99() == 0, "empty window");
+
+  uint16_t history[1000];
+  bool fillingMatches = true;
+  bool wrappedMatches = true;
+  srand(1);
+  for (size_t i = 0; i < 1000; i++) {
+    //mostly short round trips with occasional slow ones and duplicates
+    history[i] = (rand() % 10 == 0) ? 500 + rand() % 2000 : 80 + rand() % 40;
+    window.add(history[i]);
+
+    size_t count = std::min(i + 1, (size_t)TEST_WINDOW);
+    bool matches = window.getCount() == count
+                   && window.getP50() == percentile(history, i + 1, count, 50)
+                   && window.getP99() == percentile(history, i + 1, count, 99);
+    if (i < TEST_WINDOW) {
+      fillingMatches = fillingMatches && matches;
+    } else {
+      wrappedMatches = wrappedMatches && matches;
+    }
+  }
+  check(fillingMatches, "percentiles while the window fills");
+  check(wrappedMatches, "percentiles after the window wraps");
+
+  Nuki::RoundTripWindow<TEST_WINDOW> saturated;
+  saturated.add(100000);
+  check(saturated.getP99() == UINT16_MAX, "sample saturated at UINT16_MAX");
+
+  Nuki::RoundTripWindow<TEST_WINDOW> fast;
+  for (int i = 0; i < TEST_WINDOW; i++) {
+    fast.add(50);
+  }
+  check(fast.timeout(3.0f, 500, 6000) == 500, "fast link clamped to the floor");
+  check(fast.timeout(20.0f, 500, 6000) == 1000, "timeout p99 * factor between floor and ceiling");
+
+  Nuki::RoundTripWindow<TEST_WINDOW> slow;
+  for (int i = 0; i < TEST_WINDOW; i++) {
+    slow.add(2500);
+  }
+  check(slow.timeout(3.0f, 500, 6000) == 6000, "slow link clamped to the ceiling");
+  check(slow.timeout(2.0f, 500, 6000) == 5000, "slow link may exceed the default read timeout");
+  check(slow.timeout(3.0f, 8000, 6000) == 8000, "floor wins over a lower ceiling");
+
+  printf(failures == 0 ? "OK\n" : "FAILED\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file rx_queue_test.cpp
+ * Host side test of the single producer / single consumer frame queue in NukiRxQueue.h
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * Checks filling, dropping and draining on one thread, then runs a producer and a consumer thread
+ * against each other like the NimBLE host task and the protocol task: every frame is either received
+ * intact and in order or counted as dropped. Build with -fsanitize=thread to check the memory ordering.
+ *
+ * Build and run from the repository root:
+ *   g++ -O2 -std=c++17 -pthread -Isrc extras/rx_queue_test/rx_queue_test.cpp -o rx_queue_test
+ *   ./rx_queue_test
+ *
+ */
+
+#include "NukiRxQueue.h"
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+#define TEST_QUEUE_SIZE 8
+#define FRAMES 1000000
+
+struct TestFrame {
+  uint32_t sequence;
+  uint8_t data[60];
+};
+
+static int failures = 0;
+
+static void check(const bool condition, const char* description) {
+  printf("%s: %s\n", condition ? "ok  " : "FAIL", description);
+  if (!condition) {
+    failures++;
+  }
+}
+
+static void writeFrame(TestFrame* frame, const uint32_t sequence) {
+  frame->sequence = sequence;
+  memset(frame->data, sequence & 0xff, sizeof(frame->data));
+}
+
+static bool frameIntact(const TestFrame* frame) {
+  for (uint8_t byte : frame->data) {
+    if (byte != (frame->sequence & 0xff)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void testSingleThread() {
+  Nuki::RxQueue<TestFrame, TEST_QUEUE_SIZE> queue;
+  check(queue.front() == nullptr && queue.getDepth() == 0, "empty queue");
+
+  uint32_t queued = 0;
+  for (uint32_t i = 0; i < TEST_QUEUE_SIZE + 3; i++) {
+    TestFrame* frame = queue.reserve();
+    if (frame != nullptr) {
+      writeFrame(frame, i);
+      queue.commit();
+      queued++;
+    }
+  }
+  check(queued == TEST_QUEUE_SIZE && queue.getDepth() == TEST_QUEUE_SIZE, "frames up to the size queued");
+  check(queue.getDropped() == 3 && queue.getMaxDepth() == TEST_QUEUE_SIZE, "frames beyond the size dropped and counted");
+
+  queue.drop();
+  check(queue.getDropped() == 4, "frames rejected by the producer counted");
+
+  bool inOrder = true;
+  for (uint32_t i = 0; i < TEST_QUEUE_SIZE; i++) {
+    TestFrame* frame = queue.front();
+    inOrder = inOrder && frame != nullptr && frame->sequence == i && frameIntact(frame);
+    queue.pop();
+  }
+  check(inOrder && queue.front() == nullptr && queue.getDepth() == 0, "frames drained in order");
+
+  //the slots are reused after the counters moved past the size
+  TestFrame* frame = queue.reserve();
+  writeFrame(frame, 100);
+  queue.commit();
+  check(queue.front() != nullptr && queue.front()->sequence == 100 && queue.getDepth() == 1, "slot reused after draining");
+}
+
+static void testProducerConsumer() {
+  static Nuki::RxQueue<TestFrame, TEST_QUEUE_SIZE> queue;
+
+  std::thread producer([]() {
+    for (uint32_t i = 0; i < FRAMES; i++) {
+      TestFrame* frame = queue.reserve();
+      if (frame != nullptr) {
+        writeFrame(frame, i);
+        queue.commit();
+      } else {
+        //give the consumer a chance, so most frames pass the queue instead of being dropped
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint32_t received = 0;
+  uint32_t lastSequence = 0;
+  bool intact = true;
+  bool ordered = true;
+  while (true) {
+    TestFrame* frame = queue.front();
+    if (frame == nullptr) {
+      if (received + queue.getDropped() == FRAMES) {
+        break;
+      }
+      std::this_thread::yield();
+      continue;
+    }
+    intact = intact && frameIntact(frame);
+    ordered = ordered && (received == 0 || frame->sequence > lastSequence);
+    lastSequence = frame->sequence;
+    received++;
+    queue.pop();
+  }
+  producer.join();
+
+  printf("      received %u, dropped %u, max depth %u\n", received, queue.getDropped(), queue.getMaxDepth());
+  check(intact, "frames received intact");
+  check(ordered, "frames received in order");
+  check(received + queue.getDropped() == FRAMES, "every frame received or counted as dropped");
+  check(queue.getMaxDepth() <= TEST_QUEUE_SIZE && queue.getDepth() == 0, "depth bounded by the size");
+}
+
+int main() {
+  testSingleThread();
+  testProducerConsumer();
+
+  printf(failures == 0 ? "OK\n" : "FAILED\n");
+  return failures == 0 ? 0 : 1;
+}
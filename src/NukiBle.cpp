@@ -11,6 +11,7 @@
  */
 
 #include "NukiBle.h"
+#include "NukiDeviceManager.h"
 #include "NukiLockUtils.h"
 #include "NukiUtils.h"
 #include "string.h"
@@ -20,10 +21,48 @@
 #include "sodium/crypto_auth_hmacsha256.h"
 #include "sodium/crypto_secretbox.h"
 #include "sodium/crypto_box.h"
+#include "sodium/utils.h"
 #include "NimBLEBeacon.h"
 
 namespace Nuki {
 
+//indexed by ConnectionProfile, from most robust to fastest
+static const ConnectionParameters connectionProfileParameters[] = {
+  {24, 40, 0, 256, 16, 16},   //StackDefault, equal to the NimBLE defaults
+  {40, 80, 2, 600, 16, 16},   //PowerSave
+  {12, 24, 0, 400, 32, 32},   //Balanced
+  {12, 12, 0, 600, 64, 64}    //LowLatency
+};
+
+//protocol descriptors, the steps of each command type are executed by stepProtocol()
+static const ProtocolStep commandSteps[] = {ProtocolStep::SendRequest, ProtocolStep::AwaitResponse};
+static const ProtocolStep challengeSteps[] = {ProtocolStep::SendChallengeRequest, ProtocolStep::AwaitChallenge, ProtocolStep::SendCommand, ProtocolStep::AwaitResponse};
+static const ProtocolStep challengeAcceptSteps[] = {ProtocolStep::SendChallengeRequest, ProtocolStep::AwaitChallenge, ProtocolStep::SendCommand, ProtocolStep::AwaitAccept};
+static const ProtocolStep challengePinSteps[] = {ProtocolStep::SendChallengeRequest, ProtocolStep::AwaitChallenge, ProtocolStep::SendCommandWithPin, ProtocolStep::AwaitResponse};
+
+//commands not listed here use CMD_TIMEOUT and are not adaptive (writes, motor actions)
+static const CommandTimeout defaultCommandTimeouts[] = {
+  {Command::Challenge,        READ_CMD_TIMEOUT, true},
+  {Command::RequestData,      READ_CMD_TIMEOUT, true},
+  {Command::KeypadCodeCount,  GENERAL_TIMEOUT,  false},
+  {Command::KeypadCode,       GENERAL_TIMEOUT,  false}
+};
+
+//payloads decoded into a data type by decodeReturnPayload()
+static constexpr PayloadSize payloadSizes[] = {
+  payloadSizeOf<AuthorizationEntry>((uint16_t)Command::AuthorizationEntry),
+  payloadSizeOf<FingerprintEntry>((uint16_t)Command::FingerprintEntry),
+  payloadSizeOf<KeypadEntry>((uint16_t)Command::KeypadCode)
+};
+
+//indexed by CommandType
+static const ProtocolDescriptor protocolDescriptors[] = {
+  {commandSteps, sizeof(commandSteps)},                  //Command
+  {challengeSteps, sizeof(challengeSteps)},              //CommandWithChallenge
+  {challengeAcceptSteps, sizeof(challengeAcceptSteps)},  //CommandWithChallengeAndAccept
+  {challengePinSteps, sizeof(challengePinSteps)}         //CommandWithChallengeAndPin
+};
+
 NukiBle::NukiBle(const std::string& deviceName,
                  const uint32_t deviceId,
                  const NimBLEUUID pairingServiceUUID,
@@ -46,6 +85,12 @@ NukiBle::NukiBle(const std::string& deviceName,
   rssi = 0;
   lastReceivedBeaconTs = 0;
   lastHeartbeat = 0;
+  commandInProgress = false;
+  disconnecting = false;
+  usdioCachedActive = false;
+  cachedWriteStatus = 0;
+  asyncCommandPending = false;
+  autoRefreshPending = false;
 
   #ifdef DEBUG_NUKI_CONNECT
   debugNukiConnect = true;
@@ -65,14 +110,75 @@ NukiBle::NukiBle(const std::string& deviceName,
 }
 
 NukiBle::~NukiBle() {
+  if (deviceManager != nullptr) {
+    deviceManager->removeDevice(this);
+  }
+
   if (bleScanner != nullptr) {
     bleScanner->unsubscribe(this);
     bleScanner = nullptr;
   }
+
+  if (gapEventListenerRegistered) {
+    ble_gap_event_listener_unregister(&gapEventListener);
+  }
+
+  if (rxTaskHandle != nullptr) {
+    vTaskDelete(rxTaskHandle);
+    rxTaskHandle = nullptr;
+  }
+
+  if (connectTaskHandle != nullptr) {
+    vTaskDelete(connectTaskHandle);
+    connectTaskHandle = nullptr;
+  }
+
+  setKeyPairPrecompute(false);
+  if (keyPairMutex != nullptr) {
+    vSemaphoreDelete(keyPairMutex);
+    keyPairMutex = nullptr;
+  }
+
+  if (provisioningMutex != nullptr) {
+    vSemaphoreDelete(provisioningMutex);
+    provisioningMutex = nullptr;
+  }
+
+  if (connectionEvents != nullptr) {
+    vEventGroupDelete(connectionEvents);
+    connectionEvents = nullptr;
+  }
+
+  if (responseQueue != nullptr) {
+    vQueueDelete(responseQueue);
+    responseQueue = nullptr;
+  }
+
+  if (logSyncMutex != nullptr) {
+    vSemaphoreDelete(logSyncMutex);
+    logSyncMutex = nullptr;
+  }
 }
 
 void NukiBle::initialize(bool initAltConnect) {
   preferences.begin(preferencesId.c_str(), false);
+  preferencesOpen = true;
+  if (preferences.isKey(CONN_PROFILE_STORE_NAME)) {
+    ConnectionProfile storedProfile = (ConnectionProfile)preferences.getUChar(CONN_PROFILE_STORE_NAME, (uint8_t)requestedProfile);
+    if (storedProfile < requestedProfile) {
+      //a previous fallback showed the requested profile does not work with this lock
+      connectionProfile = storedProfile;
+    }
+  }
+  if (connectionEvents == nullptr) {
+    connectionEvents = xEventGroupCreate();
+  }
+  if (responseQueue == nullptr) {
+    responseQueue = xQueueCreate(1, sizeof(Command));
+  }
+  if (logSyncMutex == nullptr) {
+    logSyncMutex = xSemaphoreCreateMutex();
+  }
   #ifdef NUKI_USE_LATEST_NIMBLE
   if (!NimBLEDevice::isInitialized())
   #else
@@ -82,12 +188,35 @@ void NukiBle::initialize(bool initAltConnect) {
     NimBLEDevice::init(deviceName);
   }
 
-  pClient = NimBLEDevice::createClient();
-  pClient->setClientCallbacks(this);
-  #if !defined(CONFIG_IDF_TARGET_ESP32C5)
-  //DISABLE FOR ALL ESPS FOR NOW BASED ON ISSUES WITH C5 (2025-06-18)
-  //pClient->setConnectionParams(12,12,0,600,64,64);
-  #endif
+  if (deviceManager == nullptr) {
+    pClient = NimBLEDevice::createClient();
+    setupClient();
+  }
+
+  isPaired = retrieveCredentials();
+  loadGattCache();
+
+  if (!gapEventListenerRegistered) {
+    gapEventListenerRegistered = (ble_gap_event_listener_register(&gapEventListener, onGapEvent, this) == 0);
+  }
+
+  if (rxTaskHandle == nullptr) {
+    nonceProvider->refill();
+    xTaskCreate(rxTask, "nukiRx", NUKI_RX_TASK_STACK_SIZE, this, NUKI_RX_TASK_PRIORITY, &rxTaskHandle);
+  }
+
+  if (connectTaskHandle == nullptr) {
+    xTaskCreate(connectTask, "nukiConnect", NUKI_CONNECT_TASK_STACK_SIZE, this, NUKI_RX_TASK_PRIORITY, &connectTaskHandle);
+  }
+
+  using namespace std::placeholders;
+  callback = std::bind(&NukiBle::notifyCallback, this, _1, _2, _3, _4);
+}
+
+void NukiBle::setupClient() {
+  pClient->setClientCallbacks(this, deviceManager == nullptr);
+  connectionParamsApplied = false;
+  applyConnectionProfile();
   #ifndef NUKI_USE_LATEST_NIMBLE
   if (logger == nullptr) {
     log_d("[%s] Connect timeout %d s", deviceName.c_str(), connectTimeoutSec);
@@ -107,11 +236,127 @@ void NukiBle::initialize(bool initAltConnect) {
   }
   pClient->setConnectTimeout(connectTimeoutSec * 1000);
   #endif
+}
 
-  isPaired = retrieveCredentials();
+void NukiBle::applyConnectionProfile() {
+  const ConnectionParameters& params = connectionProfileParameters[(uint8_t)connectionProfile];
 
-  using namespace std::placeholders;
-  callback = std::bind(&NukiBle::notifyCallback, this, _1, _2, _3, _4);
+  if (debugNukiConnect) {
+    logMessageVar("Connection profile: %d", (unsigned int)connectionProfile);
+  }
+  if (connectionProfile == ConnectionProfile::StackDefault && !connectionParamsApplied) {
+    //leave the parameters of the stack alone, they are only restored after another profile changed them
+    return;
+  }
+  pClient->setConnectionParams(params.minInterval, params.maxInterval, params.latency, params.supervisionTimeout,
+                               params.scanInterval, params.scanWindow);
+  connectionParamsApplied = connectionProfile != ConnectionProfile::StackDefault;
+}
+
+void NukiBle::fallbackConnectionProfile() {
+  profileConnectFailures = 0;
+  if (!profileAutoFallback || connectionProfile == ConnectionProfile::StackDefault) {
+    return;
+  }
+
+  connectionProfile = (ConnectionProfile)((uint8_t)connectionProfile - 1);
+  connectionStats.profileFallbacks++;
+  preferences.putUChar(CONN_PROFILE_STORE_NAME, (uint8_t)connectionProfile);
+
+  logMessageVar("Connect failures, falling back to connection profile: %d", (unsigned int)connectionProfile, 2);
+  applyConnectionProfile();
+}
+
+void NukiBle::setConnectionProfile(ConnectionProfile profile, bool autoFallback) {
+  profileAutoFallback = autoFallback;
+  if (profile == requestedProfile) {
+    //a remembered fallback stays in use
+    return;
+  }
+
+  requestedProfile = profile;
+  connectionProfile = profile;
+  profileConnectFailures = 0;
+  //before initialize() the stored fallback is only applied when it is safer than the requested profile
+  if (preferencesOpen) {
+    preferences.remove(CONN_PROFILE_STORE_NAME);
+  }
+
+  if (pClient != nullptr) {
+    applyConnectionProfile();
+  }
+}
+
+ConnectionProfile NukiBle::getConnectionProfile() const {
+  return connectionProfile;
+}
+
+ConnectionStats NukiBle::getConnectionStats() const {
+  ConnectionStats stats = connectionStats;
+  stats.profile = connectionProfile;
+  return stats;
+}
+
+void NukiBle::attachClient(BLEClient* client, bool refreshAttributes) {
+  pClient = client;
+  setupClient();
+
+  if (refreshAttributes) {
+    pClient->deleteServices();
+    gattDiscovered = false;
+    usdioRegistered = false;
+  }
+}
+
+bool NukiBle::claimIdleClient(bool disconnectIdle) {
+  //the command slot stays claimed until reclaimClient() is done, so the owner does not use its client
+  if (connecting || !claimCommandSlot(0)) {
+    return false;
+  }
+
+  if (pClient == nullptr || ((pClient->isConnected() || disconnecting) && (!disconnectIdle || persistentSession))) {
+    releaseCommandSlot();
+    return false;
+  }
+  return true;
+}
+
+bool NukiBle::reclaimClient() {
+  if (pClient->isConnected() || disconnecting) {
+    if (debugNukiConnect) {
+      logMessageVar("[%s] Disconnecting idle device to free a connection", deviceName.c_str());
+    }
+    disconnectAsync();
+    if (!waitForDisconnect()) {
+      return false;
+    }
+  }
+
+  releaseClient();
+  return true;
+}
+
+void NukiBle::releaseClient() {
+  if (pClient != nullptr && pClient->isConnected()) {
+    disconnectAsync();
+    waitForDisconnect();
+  }
+
+  usdioRegistered = false;
+  usdioCachedActive = false;
+  pClient = nullptr;
+}
+
+void NukiBle::enableScanning(bool enable) {
+  if (deviceManager != nullptr) {
+    if (enable) {
+      deviceManager->resumeScanning(this);
+    } else {
+      deviceManager->pauseScanning(this);
+    }
+  } else {
+    bleScanner->enableScanning(enable);
+  }
 }
 
 #ifdef NUKI_USE_LATEST_NIMBLE
@@ -191,17 +436,9 @@ PairingResult NukiBle::pairNuki(AuthorizationIdType idType) {
       logMessage("Nuki in pairing mode found");
     }
     if (connectBle(bleAddress, true)) {
-      crypto_box_keypair(myPublicKey, myPrivateKey);
-
-      PairingState nukiPairingState = PairingState::InitPairing;
-      do {
-        nukiPairingState = pairStateMachine(nukiPairingState);
-        extendDisconnectTimeout();
-        delay(50);
-      } while ((nukiPairingState != PairingState::Success) && (nukiPairingState != PairingState::Timeout));
-
-      if (nukiPairingState == PairingState::Success) {
+      if (runPairing() == PairingState::Success) {
         saveCredentials();
+        loadGattCache();
         result = PairingResult::Success;
         #ifndef NUKI_64BIT_TIME
         lastHeartbeat = millis();
@@ -219,138 +456,914 @@ PairingResult NukiBle::pairNuki(AuthorizationIdType idType) {
     }
   }
 
-  if (debugNukiConnect) {
-    logMessageVar("pairing result %d", (unsigned int)result);
-  }
+  if (debugNukiConnect) {
+    logMessageVar("pairing result %d", (unsigned int)result);
+  }
+
+  isPaired = (result == PairingResult::Success);
+  return result;
+}
+
+void NukiBle::setKeyPairPrecompute(bool enable) {
+  if (enable) {
+    if (keyPairMutex == nullptr) {
+      keyPairMutex = xSemaphoreCreateMutex();
+    }
+    if (keyPairTaskHandle == nullptr) {
+      xTaskCreate(keyPairTask, "nukiKeyPair", KEY_PAIR_TASK_STACK_SIZE, this, KEY_PAIR_TASK_PRIORITY, &keyPairTaskHandle);
+    }
+  } else if (keyPairTaskHandle != nullptr) {
+    //holding the mutex makes sure the task is not in the middle of storing a pair
+    xSemaphoreTake(keyPairMutex, portMAX_DELAY);
+    vTaskDelete(keyPairTaskHandle);
+    keyPairTaskHandle = nullptr;
+    precomputedKeyPairReady = false;
+    sodium_memzero(precomputedPrivateKey, sizeof(precomputedPrivateKey));
+    xSemaphoreGive(keyPairMutex);
+  }
+}
+
+void NukiBle::keyPairTask(void* pvParameters) {
+  NukiBle* nukiBle = (NukiBle*)pvParameters;
+  unsigned char publicKey[32];
+  unsigned char privateKey[32];
+
+  while (true) {
+    crypto_box_keypair(publicKey, privateKey);
+
+    xSemaphoreTake(nukiBle->keyPairMutex, portMAX_DELAY);
+    memcpy(nukiBle->precomputedPublicKey, publicKey, sizeof(publicKey));
+    memcpy(nukiBle->precomputedPrivateKey, privateKey, sizeof(privateKey));
+    nukiBle->precomputedKeyPairReady = true;
+    xSemaphoreGive(nukiBle->keyPairMutex);
+    sodium_memzero(privateKey, sizeof(privateKey));
+
+    //notified when the pair is taken, otherwise an unused pair is replaced after the refresh interval
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(KEY_PAIR_REFRESH_INTERVAL));
+  }
+}
+
+bool NukiBle::takePrecomputedKeyPair() {
+  if (keyPairTaskHandle == nullptr) {
+    return false;
+  }
+
+  bool taken = false;
+  xSemaphoreTake(keyPairMutex, portMAX_DELAY);
+  if (precomputedKeyPairReady) {
+    memcpy(myPublicKey, precomputedPublicKey, sizeof(myPublicKey));
+    memcpy(myPrivateKey, precomputedPrivateKey, sizeof(myPrivateKey));
+    sodium_memzero(precomputedPrivateKey, sizeof(precomputedPrivateKey));
+    precomputedKeyPairReady = false;
+    taken = true;
+  }
+  xSemaphoreGive(keyPairMutex);
+
+  if (taken) {
+    xTaskNotifyGive(keyPairTaskHandle);
+  }
+  return taken;
+}
+
+PairingState NukiBle::runPairing() {
+  if (takePrecomputedKeyPair()) {
+    if (debugNukiConnect) {
+      logMessage("Using precomputed key pair");
+    }
+  } else {
+    crypto_box_keypair(myPublicKey, myPrivateKey);
+  }
+
+  PairingState nukiPairingState = PairingState::InitPairing;
+  do {
+    nukiPairingState = pairStateMachine(nukiPairingState);
+    extendDisconnectTimeout();
+    delay(50);
+  } while ((nukiPairingState != PairingState::Success) && (nukiPairingState != PairingState::Timeout));
+
+  return nukiPairingState;
+}
+
+bool NukiBle::startProvisioning(ProvisioningCallback callback, AuthorizationIdType idType) {
+  if (isPaired) {
+    logMessage("Provisioning not possible, already paired", 2);
+    return false;
+  }
+
+  if (provisioningMutex == nullptr) {
+    provisioningMutex = xSemaphoreCreateMutex();
+  }
+
+  xSemaphoreTake(provisioningMutex, portMAX_DELAY);
+  provisioningQueueCount = 0;
+  provisioningStats = {};
+  #ifndef NUKI_64BIT_TIME
+  provisioningStart = millis();
+  #else
+  provisioningStart = (esp_timer_get_time() / 1000);
+  #endif
+  provisioningCallback = callback;
+  authorizationIdType = idType;
+  provisioning = true;
+  xSemaphoreGive(provisioningMutex);
+
+  if (debugNukiConnect) {
+    logMessage("Provisioning started");
+  }
+  return true;
+}
+
+void NukiBle::stopProvisioning() {
+  if (provisioningMutex == nullptr) {
+    return;
+  }
+
+  xSemaphoreTake(provisioningMutex, portMAX_DELAY);
+  provisioning = false;
+  provisioningQueueCount = 0;
+  xSemaphoreGive(provisioningMutex);
+
+  if (debugNukiConnect) {
+    logMessageVar("Provisioning stopped, %d locks paired", provisioningStats.paired);
+  }
+}
+
+bool NukiBle::provisionNext() {
+  ProvisioningCandidate candidate;
+  if (!provisioning || !takeProvisioningCandidate(&candidate)) {
+    return false;
+  }
+
+  ProvisioningResult provisioningResult = {};
+  #ifdef NUKI_USE_LATEST_NIMBLE
+  const uint8_t* address = candidate.address.getVal();
+  #else
+  const uint8_t* address = candidate.address.getNative();
+  #endif
+  snprintf(provisioningResult.deviceName, sizeof(provisioningResult.deviceName), "nk%02x%02x%02x", address[2], address[1], address[0]);
+  snprintf(provisioningResult.address, sizeof(provisioningResult.address), "%s", std::string(candidate.address).c_str());
+  provisioningResult.ultra = candidate.ultra;
+  provisioningResult.result = PairingResult::Timeout;
+
+  #ifndef NUKI_64BIT_TIME
+  unsigned long pairingStart = millis();
+  #else
+  int64_t pairingStart = (esp_timer_get_time() / 1000);
+  #endif
+  provisioningResult.queuedMs = pairingStart - candidate.firstSeen;
+
+  if (debugNukiConnect) {
+    logMessageVar("Provisioning %s", provisioningResult.address);
+  }
+
+  bleAddress = candidate.address;
+  smartLockUltra = candidate.ultra;
+  encryptPairing = false;
+  recieveEncrypted = false;
+
+  if (connectBle(bleAddress, true) && runPairing() == PairingState::Success) {
+    //the credentials of every lock go to the namespace a NukiLock/NukiOpener with the derived device
+    //name would use (the suffix of the namespace of this NukiBle), this NukiBle stays unpaired
+    std::string provisionedPreferencesId = provisioningResult.deviceName;
+    if (preferencesId.compare(0, deviceName.length(), deviceName) == 0) {
+      provisionedPreferencesId += preferencesId.substr(deviceName.length());
+    }
+    //a separate instance, the namespace of this NukiBle stays open for the other tasks using it
+    Preferences provisionedPreferences;
+    provisionedPreferences.begin(provisionedPreferencesId.c_str(), false);
+    saveCredentials(provisionedPreferences);
+    provisionedPreferences.end();
+    provisioningResult.result = PairingResult::Success;
+  }
+  disconnect();
+
+  sodium_memzero(secretKeyK, sizeof(secretKeyK));
+  sodium_memzero(myPrivateKey, sizeof(myPrivateKey));
+  memset(authorizationId, 0, sizeof(authorizationId));
+  encryptPairing = false;
+  recieveEncrypted = false;
+
+  #ifndef NUKI_64BIT_TIME
+  unsigned long now = millis();
+  #else
+  int64_t now = (esp_timer_get_time() / 1000);
+  #endif
+  provisioningResult.pairingMs = now - pairingStart;
+
+  xSemaphoreTake(provisioningMutex, portMAX_DELAY);
+  if (provisioningResult.result == PairingResult::Success) {
+    provisioningStats.paired++;
+    provisionedAddresses[provisionedAddressIndex] = candidate.address;
+    provisionedAddressIndex = (provisionedAddressIndex + 1) % NUKI_PROVISION_QUEUE_SIZE;
+  } else {
+    provisioningStats.failed++;
+  }
+  xSemaphoreGive(provisioningMutex);
+
+  if (debugNukiConnect) {
+    logMessageVar("Provisioning result %d", (unsigned int)provisioningResult.result);
+    logMessageVar("Provisioning took %d ms", provisioningResult.pairingMs);
+  }
+
+  if (provisioningCallback) {
+    provisioningCallback(provisioningResult);
+  }
+  return true;
+}
+
+uint8_t NukiBle::getProvisioningQueueDepth() {
+  if (provisioningMutex == nullptr) {
+    return 0;
+  }
+
+  xSemaphoreTake(provisioningMutex, portMAX_DELAY);
+  uint8_t depth = provisioningQueueCount;
+  xSemaphoreGive(provisioningMutex);
+  return depth;
+}
+
+ProvisioningStats NukiBle::getProvisioningStats() const {
+  ProvisioningStats stats = provisioningStats;
+  #ifndef NUKI_64BIT_TIME
+  stats.elapsedMs = provisioningStart > 0 ? millis() - provisioningStart : 0;
+  #else
+  stats.elapsedMs = provisioningStart > 0 ? (esp_timer_get_time() / 1000) - provisioningStart : 0;
+  #endif
+  stats.locksPerHour = stats.elapsedMs > 0 ? stats.paired * 3600000.0f / stats.elapsedMs : 0;
+  return stats;
+}
+
+void NukiBle::queueProvisioningCandidate(const BLEAddress& address, const bool ultra) {
+  #ifndef NUKI_64BIT_TIME
+  unsigned long now = millis();
+  #else
+  int64_t now = (esp_timer_get_time() / 1000);
+  #endif
+
+  xSemaphoreTake(provisioningMutex, portMAX_DELAY);
+  bool known = false;
+  for (uint8_t i = 0; i < NUKI_PROVISION_QUEUE_SIZE && !known; i++) {
+    //a lock can still advertise pairing mode shortly after it has been paired
+    known = provisionedAddresses[i] == address;
+  }
+  for (uint8_t i = 0; i < provisioningQueueCount && !known; i++) {
+    if (provisioningQueue[i].address == address) {
+      provisioningQueue[i].lastSeen = now;
+      known = true;
+    }
+  }
+  if (!known) {
+    if (provisioningQueueCount < NUKI_PROVISION_QUEUE_SIZE) {
+      provisioningQueue[provisioningQueueCount++] = {address, ultra, now, now};
+      if (debugNukiConnect) {
+        logMessageVar("Queued for provisioning: %s", std::string(address).c_str());
+      }
+    } else {
+      logMessage("Provisioning queue full, lock ignored", 2);
+    }
+  }
+  xSemaphoreGive(provisioningMutex);
+}
+
+bool NukiBle::takeProvisioningCandidate(ProvisioningCandidate* candidate) {
+  #ifndef NUKI_64BIT_TIME
+  unsigned long now = millis();
+  #else
+  int64_t now = (esp_timer_get_time() / 1000);
+  #endif
+
+  bool taken = false;
+  xSemaphoreTake(provisioningMutex, portMAX_DELAY);
+  while (provisioningQueueCount > 0 && !taken) {
+    *candidate = provisioningQueue[0];
+    provisioningQueueCount--;
+    for (uint8_t i = 0; i < provisioningQueueCount; i++) {
+      provisioningQueue[i] = provisioningQueue[i + 1];
+    }
+
+    if (now - candidate->lastSeen > PROVISION_STALE_TIMEOUT) {
+      provisioningStats.expired++;
+      if (debugNukiConnect) {
+        logMessageVar("Lock left pairing mode before provisioning: %s", std::string(candidate->address).c_str());
+      }
+    } else {
+      taken = true;
+    }
+  }
+  xSemaphoreGive(provisioningMutex);
+  return taken;
+}
+
+void NukiBle::unPairNuki() {
+  deleteCredentials();
+  isPaired = false;
+  if (debugNukiConnect) {
+    logMessageVar("[%s] Credentials deleted", deviceName.c_str());
+  }
+}
+
+void NukiBle::resetHost() {
+  if (debugNukiConnect) {
+    logMessageVar("[%s] Resetting BLE host", deviceName.c_str());
+  }
+
+  ble_hs_sched_reset(0);
+}
+
+bool NukiBle::connectBle(const BLEAddress bleAddress, bool pairing) {
+  if (!pairing && !connectAllowed()) {
+    return false;
+  }
+
+  if (xTaskGetCurrentTaskHandle() == rxTaskHandle && (pClient == nullptr || !pClient->isConnected())) {
+    //async commands are connected by the connect task, the protocol task never blocks on a connect
+    logMessage("Link lost during async command", 2);
+    return false;
+  }
+
+  connecting = true;
+  enableScanning(false);
+
+  if (deviceManager != nullptr && pClient == nullptr) {
+    pClient = deviceManager->acquireClient(this);
+    if (pClient == nullptr) {
+      if (debugNukiConnect) {
+        logMessageVar("[%s] No connection slot available", deviceName.c_str());
+      }
+      enableScanning(true);
+      connecting = false;
+      return false;
+    }
+  }
+
+  if (debugNukiConnect) {
+    #if (ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0))
+    logMessageVar("connecting within: %s", pcTaskGetTaskName(xTaskGetCurrentTaskHandle()));
+    #else
+    logMessageVar("connecting within: %s", pcTaskGetName(xTaskGetCurrentTaskHandle()));
+    #endif
+  }
+
+  uint8_t connectRetry = 0;
+  uint8_t maxRetries = circuitBreaker.getMaxAttempts(connectRetries);
+
+  while (connectRetry < maxRetries) {
+    if (disconnecting) {
+      //a connect attempt on a link that is being torn down fails, first let the disconnect complete
+      waitForDisconnect();
+    }
+
+    if(!pClient->isConnected()) {
+      if (deviceManager != nullptr) {
+        deviceManager->beginConnect();
+      }
+      bool connected = pClient->connect(bleAddress, refreshServices);
+      if (deviceManager != nullptr) {
+        deviceManager->endConnect();
+      }
+
+      if (!connected) {
+        if (debugNukiConnect) {
+          logMessageVar("[%s] Failed to connect", deviceName.c_str());
+        }
+        connectionStats.connectFailures++;
+        if (++profileConnectFailures >= CONN_PROFILE_FALLBACK_FAILURES) {
+          fallbackConnectionProfile();
+        }
+        connectRetry++;
+        waitBeforeRetry(connectRetry);
+        continue;
+      } else {
+        refreshServices = false;
+        profileConnectFailures = 0;
+        connectionStats.connects++;
+      }
+    }
+
+    if (debugNukiConnect) {
+      if (logger == nullptr) {
+        log_d("[%s] Connected to: %s RSSI: %d", deviceName.c_str(), pClient->getPeerAddress().toString().c_str(), pClient->getRssi());
+      }
+      else
+      {
+        logger->printf("[%s] Connected to: %s RSSI: %d\r\n", deviceName.c_str(), pClient->getPeerAddress().toString().c_str(), pClient->getRssi());
+      }
+    }
+
+    if(pairing) {
+      if (!registerOnGdioChar()) {
+        if (debugNukiConnect) {
+          logMessageVar("[%s] Failed to connect on registering GDIO", deviceName.c_str());
+        }
+        connectRetry++;
+        waitBeforeRetry(connectRetry);
+        continue;
+      }
+    } else if (!usdioRegistered) {
+      if (!registerOnCachedUsdioHandle() && !registerOnUsdioChar()) {
+        if (debugNukiConnect) {
+          logMessageVar("[%s] Failed to connect on registering USDIO", deviceName.c_str());
+        }
+        connectRetry++;
+        waitBeforeRetry(connectRetry);
+        continue;
+      }
+      usdioRegistered = true;
+    }
+
+    if (circuitBreaker.connectSucceeded() && debugNukiConnect) {
+      logMessage("Probe connect succeeded, circuit closed");
+    }
+    enableScanning(true);
+    connecting = false;
+    return true;
+  }
+
+  circuitBreaker.connectFailed();
+  enableScanning(true);
+  connecting = false;
+  return false;
+}
+
+void NukiBle::setAutoRefresh(bool enable, bool includeBatteryReport, uint32_t debounceMs) {
+  autoRefresh = enable;
+  autoRefreshBattery = includeBatteryReport;
+  autoRefreshDebounce = debounceMs;
+}
+
+void NukiBle::setConfigCache(bool enable) {
+  configCacheEnabled = enable;
+  invalidateConfigCache();
+}
+
+void NukiBle::invalidateConfigCache() {
+  configCacheValid = false;
+  advancedConfigCacheValid = false;
+}
+
+void NukiBle::checkConfigUpdateCount(const uint8_t configUpdateCount) {
+  if (configUpdateCount != cachedConfigUpdateCount) {
+    if (debugNukiCommunication && (configCacheValid || advancedConfigCacheValid)) {
+      logMessage("Config update count changed, config cache invalidated");
+    }
+    invalidateConfigCache();
+    cachedConfigUpdateCount = configUpdateCount;
+  }
+}
+
+void NukiBle::triggerAutoRefresh() {
+  #ifndef NUKI_64BIT_TIME
+  unsigned long now = millis();
+  #else
+  int64_t now = (esp_timer_get_time() / 1000);
+  #endif
+
+  //the status changed flag is repeated in every advertisement until the state has been read
+  if (autoRefreshPending || (lastAutoRefresh != 0 && now - lastAutoRefresh < autoRefreshDebounce)) {
+    return;
+  }
+
+  if (debugNukiCommunication) {
+    logMessage("Status changed, refreshing state");
+  }
+  lastAutoRefresh = now;
+  autoRefreshPending = true;
+
+  //runs on the scanner task, so only submit and handle the result on the protocol task
+  requestStateAsync([this](const Nuki::CmdResult result) {
+    if (result != Nuki::CmdResult::Success) {
+      //try again on the next advertisement
+      lastAutoRefresh = 0;
+      autoRefreshPending = false;
+      return;
+    }
+
+    if (eventHandler) {
+      eventHandler->notify(EventType::KeyTurnerStatusRefreshed);
+    }
+
+    if (!autoRefreshBattery) {
+      autoRefreshPending = false;
+      return;
+    }
+
+    requestBatteryReportAsync([this](const Nuki::CmdResult result) {
+      if (result == Nuki::CmdResult::Success && eventHandler) {
+        eventHandler->notify(EventType::BatteryReportRefreshed);
+      }
+      autoRefreshPending = false;
+    });
+  });
+}
+
+bool NukiBle::connectAllowed() {
+  BLEClient* client = pClient;
+  if (!circuitBreaker.isEnabled() || lastReceivedBeaconTs == 0 || (client != nullptr && client->isConnected())) {
+    return true;
+  }
+
+  #ifndef NUKI_64BIT_TIME
+  unsigned long now = millis();
+  uint32_t sinceAdvertisement = now - lastReceivedBeaconTs;
+  uint32_t sinceLinkActivity = now - lastLinkActivity;
+  #else
+  int64_t now = (esp_timer_get_time() / 1000);
+  uint32_t sinceAdvertisement = std::min<int64_t>(now - lastReceivedBeaconTs, UINT32_MAX);
+  uint32_t sinceLinkActivity = std::min<int64_t>(now - lastLinkActivity, UINT32_MAX);
+  #endif
+  //lastHeartbeat is also extended when a command starts, so use the last data received over the link instead
+  if (circuitBreaker.checkStale(sinceAdvertisement, sinceLinkActivity)) {
+    logMessage("No advertisements received from lock, circuit opened", 2);
+  }
+
+  //onResult() half opens the circuit when advertisements are received again
+  if (circuitBreaker.getState() == CircuitState::Open) {
+    if (debugNukiConnect) {
+      logMessage("Circuit open, connect skipped");
+    }
+    return false;
+  }
+  return true;
+}
+
+void NukiBle::waitBeforeRetry(uint8_t retry) {
+  #ifndef NUKI_NO_WDT_RESET
+  esp_task_wdt_reset();
+  #endif
+  delay(retryPolicy->getRetryDelay(retry));
+}
+
+void NukiBle::setConnectRetryPolicy(ConnectRetryPolicy* retryPolicy) {
+  this->retryPolicy = retryPolicy != nullptr ? retryPolicy : &defaultRetryPolicy;
+}
+
+void NukiBle::setCircuitBreaker(bool enable, uint32_t staleTimeoutMs) {
+  circuitBreaker.setEnabled(enable, staleTimeoutMs);
+}
+
+CircuitState NukiBle::getCircuitState() const {
+  return circuitBreaker.getState();
+}
+
+void NukiBle::setNonceProvider(NonceProvider* provider) {
+  nonceProvider = provider != nullptr ? provider : &hardwareNonceProvider;
+}
+
+bool NukiBle::setCommandTimeout(const Command command, const uint16_t timeoutMs, const bool adaptive) {
+  for (uint8_t i = 0; i < timeoutOverrideCount; i++) {
+    if (timeoutOverrides[i].command == command) {
+      timeoutOverrides[i].timeoutMs = timeoutMs;
+      timeoutOverrides[i].adaptive = adaptive;
+      return true;
+    }
+  }
+
+  if (timeoutOverrideCount >= NUKI_TIMEOUT_OVERRIDES) {
+    logMessage("Max nr of command timeout overrides reached", 2);
+    return false;
+  }
+  timeoutOverrides[timeoutOverrideCount++] = {command, timeoutMs, adaptive};
+  return true;
+}
+
+const CommandTimeout* NukiBle::findCommandTimeout(const Command command) const {
+  for (uint8_t i = 0; i < timeoutOverrideCount; i++) {
+    if (timeoutOverrides[i].command == command) {
+      return &timeoutOverrides[i];
+    }
+  }
+  for (const CommandTimeout& timeout : defaultCommandTimeouts) {
+    if (timeout.command == command) {
+      return &timeout;
+    }
+  }
+  return nullptr;
+}
+
+uint16_t NukiBle::getCommandTimeout(const Command command) const {
+  const CommandTimeout* timeout = findCommandTimeout(command);
+  return timeout != nullptr ? timeout->timeoutMs : CMD_TIMEOUT;
+}
+
+uint32_t NukiBle::getStepTimeout(const Command command) const {
+  const CommandTimeout* timeout = findCommandTimeout(command);
+  if (timeout == nullptr) {
+    return CMD_TIMEOUT;
+  }
+
+  if (adaptiveTimeoutsEnabled && timeout->adaptive && roundTrips.getCount() >= RTT_MIN_SAMPLES) {
+    return roundTrips.timeout(adaptiveTimeoutFactor, adaptiveTimeoutFloor, adaptiveTimeoutCeiling);
+  }
+  return timeout->timeoutMs;
+}
+
+void NukiBle::setAdaptiveTimeouts(const bool enable, const float factor, const uint16_t floorMs, const uint16_t ceilingMs) {
+  adaptiveTimeoutsEnabled = enable;
+  adaptiveTimeoutFactor = factor;
+  adaptiveTimeoutFloor = floorMs;
+  adaptiveTimeoutCeiling = ceilingMs;
+}
+
+Nuki::CmdResult NukiBle::syncLog(const uint16_t pageSize) {
+  if (!logSyncCursorLoaded) {
+    logSyncStats.cursor = preferences.getUInt(LOG_CURSOR_STORE_NAME, 0);
+    logSyncCursorLoaded = true;
+  }
+  const uint32_t startCursor = logSyncStats.cursor;
+  logSyncStats.entries = 0;
+  logSyncStats.missingEntries = 0;
+  logSyncStats.resetDetected = false;
+
+  Nuki::CmdResult result;
+  for (uint16_t page = 0; page < LOG_SYNC_MAX_PAGES; page++) {
+    if (debugNukiCommand) {
+      logMessageVar("Sync log entries from index %d", logSyncStats.cursor + 1);
+    }
+    const uint32_t pageCursor = logSyncStats.cursor;
+    openLogPage(pageCursor, false);
+    result = requestLogPage(pageCursor + 1, pageSize, 0);
+    if (result == Nuki::CmdResult::Success) {
+      result = waitForLogPage(pageSize);
+    }
+    LogSyncPage logPage = closeLogPage();
+    logSyncStats.cursor = logPage.cursor;
+    logSyncStats.entries += logPage.entries;
+    logSyncStats.missingEntries += logPage.missingEntries;
+
+    if (result != Nuki::CmdResult::Success || logSyncReceived < pageSize) {
+      break;
+    }
+    if (logSyncStats.cursor == pageCursor) {
+      //a full page without new entries, requesting it again would return the same page
+      logMessage("Log sync page without new entries, sync stopped", 2);
+      break;
+    }
+  }
+
+  if (result == Nuki::CmdResult::Success && logSyncStats.entries == 0 && logSyncStats.cursor > 0) {
+    //nothing new, check whether the log on the lock restarted (ie factory reset) below the cursor
+    openLogPage(logSyncStats.cursor, true);
+    result = requestLogPage(0, 1, 1);
+    if (result == Nuki::CmdResult::Success) {
+      result = waitForLogPage(1);
+    }
+    LogSyncPage logPage = closeLogPage();
+
+    if (result == Nuki::CmdResult::Success && logPage.newestIndex < logSyncStats.cursor) {
+      logMessageVar("Log on lock restarted at index %d, log cursor reset", logPage.newestIndex, 2);
+      logSyncStats.resetDetected = true;
+      logSyncStats.cursor = 0;
+    }
+  }
+
+  if (logSyncStats.cursor != startCursor) {
+    saveLogSyncCursor();
+  }
+  return result;
+}
+
+Nuki::CmdResult NukiBle::waitForLogPage(const uint16_t count) {
+  uint16_t received = logSyncReceived;
+  #ifndef NUKI_64BIT_TIME
+  unsigned long lastEntry = millis();
+  #else
+  int64_t lastEntry = (esp_timer_get_time() / 1000);
+  #endif
+
+  //the page is done when all requested entries are received or the lock terminated the list
+  while (logSyncReceived < count && !logSyncComplete) {
+    if (logSyncReceived != received) {
+      received = logSyncReceived;
+      #ifndef NUKI_64BIT_TIME
+      lastEntry = millis();
+      #else
+      lastEntry = (esp_timer_get_time() / 1000);
+      #endif
+    }
+    #ifndef NUKI_64BIT_TIME
+    uint32_t elapsed = millis() - lastEntry;
+    #else
+    uint32_t elapsed = (esp_timer_get_time() / 1000) - lastEntry;
+    #endif
+    if (elapsed > getCommandTimeout(Command::LogEntry)) {
+      logMessage("Receive log entries timeout", 2);
+      return Nuki::CmdResult::TimeOut;
+    }
+    #ifndef NUKI_NO_WDT_RESET
+    esp_task_wdt_reset();
+    #endif
+    waitForResponse(getCommandTimeout(Command::LogEntry) - elapsed);
+  }
+  return Nuki::CmdResult::Success;
+}
+
+void NukiBle::openLogPage(const uint32_t cursor, const bool probing) {
+  xSemaphoreTake(logSyncMutex, portMAX_DELAY);
+  logSyncPage = {};
+  logSyncPage.open = true;
+  logSyncPage.probing = probing;
+  logSyncPage.cursor = cursor;
+  logSyncReceived = 0;
+  logSyncComplete = false;
+  xSemaphoreGive(logSyncMutex);
+}
 
-  isPaired = (result == PairingResult::Success);
-  return result;
+NukiBle::LogSyncPage NukiBle::closeLogPage() {
+  //entries arriving after the page is closed (ie after a timeout) are ignored
+  xSemaphoreTake(logSyncMutex, portMAX_DELAY);
+  logSyncPage.open = false;
+  LogSyncPage logPage = logSyncPage;
+  xSemaphoreGive(logSyncMutex);
+  return logPage;
 }
 
-void NukiBle::unPairNuki() {
-  deleteCredentials();
-  isPaired = false;
-  if (debugNukiConnect) {
-    logMessageVar("[%s] Credentials deleted", deviceName.c_str());
+bool NukiBle::acceptLogEntry(const uint32_t index) {
+  bool accepted = false;
+  uint32_t missing = 0;
+
+  xSemaphoreTake(logSyncMutex, portMAX_DELAY);
+  if (!logSyncPage.open) {
+    //not requested by syncLog()
+  } else if (logSyncPage.probing) {
+    logSyncPage.newestIndex = index;
+  } else if (index > logSyncPage.cursor) {
+    if (logSyncPage.cursor > 0 && index != logSyncPage.cursor + 1) {
+      missing = index - logSyncPage.cursor - 1;
+      logSyncPage.missingEntries += missing;
+    }
+    logSyncPage.cursor = index;
+    logSyncPage.entries++;
+    accepted = true;
   }
-}
+  xSemaphoreGive(logSyncMutex);
+  //counted after the page is updated, so the page is complete when the waiting task sees the count
+  logSyncReceived++;
 
-void NukiBle::resetHost() {
-  if (debugNukiConnect) {
-    logMessageVar("[%s] Resetting BLE host", deviceName.c_str());
+  if (missing > 0 && debugNukiCommand) {
+    logMessageVar("Log index gap, %d entries missing", missing);
   }
+  return accepted;
+}
 
-  ble_hs_sched_reset(0);
+void NukiBle::saveLogSyncCursor() {
+  preferences.putUInt(LOG_CURSOR_STORE_NAME, logSyncStats.cursor);
 }
 
-bool NukiBle::connectBle(const BLEAddress bleAddress, bool pairing) {
-  connecting = true;
-  bleScanner->enableScanning(false);
+LogSyncStats NukiBle::getLogSyncStats() const {
+  return logSyncStats;
+}
 
-  if (debugNukiConnect) {
-    #if (ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 0, 0))
-    logMessageVar("connecting within: %s", pcTaskGetTaskName(xTaskGetCurrentTaskHandle()));
+void NukiBle::resetLogSyncCursor() {
+  logSyncStats.cursor = 0;
+  logSyncCursorLoaded = true;
+  saveLogSyncCursor();
+}
+
+RoundTripStats NukiBle::getRoundTripStats() const {
+  RoundTripStats stats;
+  stats.samples = roundTrips.getCount();
+  stats.p50 = roundTrips.getP50();
+  stats.p99 = roundTrips.getP99();
+  stats.adaptiveTimeout = 0;
+  if (adaptiveTimeoutsEnabled && roundTrips.getCount() >= RTT_MIN_SAMPLES) {
+    stats.adaptiveTimeout = roundTrips.timeout(adaptiveTimeoutFactor, adaptiveTimeoutFloor, adaptiveTimeoutCeiling);
+  }
+  return stats;
+}
+
+void NukiBle::updateConnectionState() {
+  if (disconnecting) {
+    #ifndef NUKI_64BIT_TIME
+    if (millis() - disconnectStart > DISCONNECT_TIMEOUT) {
     #else
-    logMessageVar("connecting within: %s", pcTaskGetName(xTaskGetCurrentTaskHandle()));
+    if ((esp_timer_get_time() / 1000) - disconnectStart > DISCONNECT_TIMEOUT) {
     #endif
+      //no disconnect event received, report the failed disconnect. The client is only used while
+      //holding the command slot, the device manager may be reclaiming it otherwise
+      if (claimCommandSlot(0)) {
+        waitForDisconnect(0);
+        releaseCommandSlot();
+      }
+    }
+    return;
   }
 
-  uint8_t connectRetry = 0;
+  if (connecting) {
+    return;
+  }
 
-  while (connectRetry < connectRetries) {
-    if(!pClient->isConnected()) {
-      if (!pClient->connect(bleAddress, refreshServices)) {
-        if (debugNukiConnect) {
-          logMessageVar("[%s] Failed to connect", deviceName.c_str());
-        }
-        connectRetry++;
-        #ifndef NUKI_NO_WDT_RESET
-        esp_task_wdt_reset();
-        #endif
-        delay(50);
-        continue;
-      } else {
-        refreshServices = false;
-      }
-    }
+  if (persistentSession) {
+    keepSessionAlive();
+    return;
+  }
 
-    if (debugNukiConnect) {
-      if (logger == nullptr) {
-        log_d("[%s] Connected to: %s RSSI: %d", deviceName.c_str(), pClient->getPeerAddress().toString().c_str(), pClient->getRssi());
-      }
-      else
-      {
-        logger->printf("[%s] Connected to: %s RSSI: %d\r\n", deviceName.c_str(), pClient->getPeerAddress().toString().c_str(), pClient->getRssi());
-      }
+  #ifndef NUKI_64BIT_TIME
+  if (lastStartTimeout != 0 && (millis() - lastStartTimeout > timeoutDuration)) {
+  #else
+  if (lastStartTimeout != 0 && ((esp_timer_get_time() / 1000) - lastStartTimeout > timeoutDuration)) {
+  #endif
+    if (!claimCommandSlot(0)) {
+      //a command (or the device manager) is using the client, try again later
+      return;
     }
 
-    if(pairing) {
-      if (!registerOnGdioChar()) {
-        if (debugNukiConnect) {
-          logMessageVar("[%s] Failed to connect on registering GDIO", deviceName.c_str());
-        }
-        connectRetry++;
-        #ifndef NUKI_NO_WDT_RESET
-        esp_task_wdt_reset();
-        #endif
-        delay(50);
-        continue;
-      }
-    } else {
-      if (!registerOnUsdioChar()) {
-        if (debugNukiConnect) {
-          logMessageVar("[%s] Failed to connect on registering USDIO", deviceName.c_str());
-        }
-        connectRetry++;
-        #ifndef NUKI_NO_WDT_RESET
-        esp_task_wdt_reset();
-        #endif
-        delay(50);
-        continue;
+    BLEClient* client = pClient;
+    if (client != nullptr && client->isConnected()) {
+      if (debugNukiConnect) {
+        logMessage("disconnecting BLE on timeout");
       }
+
+      disconnect();
     }
 
-    bleScanner->enableScanning(true);
-    connecting = false;
-    return true;
+    lastStartTimeout = 0;
+    releaseCommandSlot();
   }
-
-  bleScanner->enableScanning(true);
-  connecting = false;
-  return false;
 }
 
-void NukiBle::updateConnectionState() {
-  if (connecting || disconnecting) {
+void NukiBle::keepSessionAlive() {
+  if (!isPaired) {
+    return;
+  }
+
+  //claimed like a command, so no command (or the device manager) uses the client at the same time
+  if (!claimCommandSlot(0)) {
+    return;
+  }
+
+  BLEClient* client = pClient;
+  if (client == nullptr && deviceManager == nullptr) {
+    releaseCommandSlot();
+    return;
+  }
+
+  if (client == nullptr || !client->isConnected()) {
+    //link lost (or not yet established), reconnect and resubscribe
+    #ifndef NUKI_64BIT_TIME
+    if (millis() - lastReconnectAttempt > RECONNECT_INTERVAL) {
+      lastReconnectAttempt = millis();
+    #else
+    if ((esp_timer_get_time() / 1000) - lastReconnectAttempt > RECONNECT_INTERVAL) {
+      lastReconnectAttempt = (esp_timer_get_time() / 1000);
+    #endif
+      if (debugNukiConnect) {
+        logMessage("Persistent session: link lost, reconnecting");
+      }
+      if (connectBle(bleAddress, false)) {
+        extendDisconnectTimeout();
+      }
+    }
+    releaseCommandSlot();
     return;
   }
 
+  //a command or any message from the lock within the interval already kept the link alive
   #ifndef NUKI_64BIT_TIME
-  if (lastStartTimeout != 0 && (millis() - lastStartTimeout > timeoutDuration)) {
+  if (lastStartTimeout == 0 || millis() - lastStartTimeout <= keepAliveInterval
+      || millis() - lastHeartbeat <= keepAliveInterval) {
   #else
-  if (lastStartTimeout != 0 && ((esp_timer_get_time() / 1000) - lastStartTimeout > timeoutDuration)) {
+  if (lastStartTimeout == 0 || (esp_timer_get_time() / 1000) - lastStartTimeout <= keepAliveInterval
+      || (esp_timer_get_time() / 1000) - lastHeartbeat <= keepAliveInterval) {
   #endif
-    if (pClient) {
-      if (pClient->isConnected()) {
-        if (debugNukiConnect) {
-          logMessage("disconnecting BLE on timeout");
-        }
+    releaseCommandSlot();
+    return;
+  }
 
-        disconnect();
-      }
-    }
+  if (debugNukiConnect) {
+    logMessage("Persistent session: sending keep-alive");
+  }
+  //single request without challenge, run on the slot claimed above instead of through executeAction,
+  //a command claiming the slot meanwhile waits for it (see claimCommandSlot)
+  NukiLock::Action action;
+  uint16_t payload = (uint16_t)Command::KeyturnerStates;
 
-    lastStartTimeout = 0;
+  action.cmdType = Nuki::CommandType::Command;
+  action.command = Command::RequestData;
+  memcpy(&action.payload[0], &payload, sizeof(payload));
+  action.payloadLen = sizeof(payload);
+
+  keepAliveRunning = true;
+  Nuki::CmdResult result = runAction(action);
+  keepAliveRunning = false;
+  releaseCommandSlot();
+
+  if (result != Nuki::CmdResult::Success) {
+    logMessage("Persistent session: keep-alive failed", 2);
   }
 }
 
 void NukiBle::disconnect()
 {
+  disconnectAsync();
+}
+
+bool NukiBle::disconnectAsync() {
   if (disconnecting) {
-    return;
+    return true;
   }
 
-  disconnecting = true;
+  usdioRegistered = false;
+  usdioCachedActive = false;
 
   if (pGdioCharacteristic != nullptr) {
     pGdioCharacteristic->unsubscribe(false);
@@ -366,36 +1379,47 @@ void NukiBle::disconnect()
   pUsdioCharacteristic = nullptr;
   pKeyturnerDataService = nullptr;
 
+  if (pClient && pClient->isConnected()) {
+    if (debugNukiConnect) {
+      logMessage("Disconnecting BLE");
+    }
 
-  if (pClient) {
-    if (pClient->isConnected()) {
-      if (debugNukiConnect) {
-        logMessage("Disconnecting BLE");
-      }
+    //completion is signalled by onDisconnect()
+    #ifndef NUKI_64BIT_TIME
+    disconnectStart = millis();
+    #else
+    disconnectStart = (esp_timer_get_time() / 1000);
+    #endif
+    disconnecting = true;
+    xEventGroupClearBits(connectionEvents, DISCONNECTED_BIT);
+    pClient->disconnect();
+    return true;
+  }
+  return false;
+}
 
-      countDisconnects++;
-      pClient->disconnect();
-      int loop = 0;
+bool NukiBle::waitForDisconnect(uint32_t timeoutMs) {
+  if (!disconnecting) {
+    return true;
+  }
 
-      while ((countDisconnects > 0 || pClient->isConnected()) && loop < 50) {
-        if (debugNukiConnect) {
-          logMessage(".");
-        }
-        loop++;
-        delay(100);
-      }
+  EventBits_t bits = xEventGroupWaitBits(connectionEvents, DISCONNECTED_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeoutMs));
+  bool connected = pClient != nullptr && pClient->isConnected();
+  //still disconnecting while the disconnect event is outstanding, a later wait picks it up
+  if ((bits & DISCONNECTED_BIT) || !connected) {
+    disconnecting = false;
+  }
 
-      if (pClient->isConnected())
-      {
-        if (debugNukiConnect) {
-          logMessage("Error while disconnecting BLE client");
-        }
-        eventHandler->notify(EventType::BLE_ERROR_ON_DISCONNECT);
-      }
+  if (connected) {
+    if (debugNukiConnect) {
+      logMessage("Error while disconnecting BLE client");
     }
+    if (eventHandler) {
+      eventHandler->notify(EventType::BLE_ERROR_ON_DISCONNECT);
+    }
+    return false;
   }
-
-  disconnecting = false;
+  return true;
 }
 
 void NukiBle::setDisconnectTimeout(uint32_t timeoutMs) {
@@ -406,10 +1430,33 @@ void NukiBle::setConnectTimeout(uint8_t timeout) {
   connectTimeoutSec = timeout;
 }
 
+void NukiBle::setCommandSlotTimeout(const uint32_t timeoutMs) {
+  commandSlotTimeout = timeoutMs;
+}
+
 void NukiBle::setConnectRetries(uint8_t retries) {
   connectRetries = retries;
 }
 
+void NukiBle::setGattCache(bool enable) {
+  gattCacheEnabled = enable;
+}
+
+void NukiBle::setPersistentSession(bool enable, uint32_t keepAliveIntervalMs) {
+  persistentSession = enable;
+  keepAliveInterval = keepAliveIntervalMs;
+
+  BLEClient* client = pClient;
+  if (!enable && client && client->isConnected()) {
+    //let updateConnectionState() close the connection on the normal disconnect timeout
+    extendDisconnectTimeout();
+  }
+}
+
+bool NukiBle::isPersistentSession() const {
+  return persistentSession;
+}
+
 void NukiBle::extendDisconnectTimeout() {
   #ifndef NUKI_64BIT_TIME
   lastStartTimeout = millis();
@@ -434,6 +1481,10 @@ void NukiBle::onResult(const BLEAdvertisedDevice* advertisedDevice) {
       lastReceivedBeaconTs = (esp_timer_get_time() / 1000);
       #endif
 
+      if (circuitBreaker.advertisementReceived() && debugNukiConnect) {
+        logMessage("Lock advertising again, circuit half open");
+      }
+
       std::string manufacturerData = advertisedDevice->getManufacturerData();
       uint8_t* manufacturerDataPtr = (uint8_t*)manufacturerData.data();
       bool isKeyTurnerUUID = true;
@@ -504,6 +1555,10 @@ void NukiBle::onResult(const BLEAdvertisedDevice* advertisedDevice) {
               eventHandler->notify(EventType::KeyTurnerStatusUpdated);
             }
 
+            if (autoRefresh) {
+              triggerAutoRefresh();
+            }
+
             statusUpdated = true;
           }
           else if (statusUpdated)
@@ -517,6 +1572,18 @@ void NukiBle::onResult(const BLEAdvertisedDevice* advertisedDevice) {
         }
       }
     }
+  } else if (provisioning) {
+    if (advertisedDevice->haveServiceData()) {
+      if (advertisedDevice->getServiceData(pairingServiceUUID) != "") {
+        queueProvisioningCandidate(advertisedDevice->getAddress(), false);
+      } else if (advertisedDevice->getServiceData(pairingServiceUltraUUID) != "") {
+        if (ultraPinCode == 000000) {
+          logMessage("No pairing PIN code set, not provisioning Nuki SmartLock Ultra");
+        } else {
+          queueProvisioningCandidate(advertisedDevice->getAddress(), true);
+        }
+      }
+    }
   } else {
     if (advertisedDevice->haveServiceData()) {
       if (advertisedDevice->getServiceData(pairingServiceUUID) != "") {
@@ -565,7 +1632,7 @@ void NukiBle::onResult(const BLEAdvertisedDevice* advertisedDevice) {
   }
 }
 
-Nuki::CmdResult NukiBle::retrieveKeypadEntries(const uint16_t offset, const uint16_t count) {
+Nuki::CmdResult NukiBle::retrieveKeypadEntries(const uint16_t offset, const uint16_t count, KeypadEntryCallback callback) {
   NukiLock::Action action;
   unsigned char payload[4] = {0};
   memcpy(payload, &offset, 2);
@@ -577,6 +1644,7 @@ Nuki::CmdResult NukiBle::retrieveKeypadEntries(const uint16_t offset, const uint
   action.payloadLen = sizeof(payload);
 
   listOfKeyPadEntries.clear();
+  keypadEntryCallback = callback;
   nrOfReceivedKeypadCodes = 0;
   keypadCodeCountReceived = false;
 
@@ -591,15 +1659,19 @@ Nuki::CmdResult NukiBle::retrieveKeypadEntries(const uint16_t offset, const uint
     //wait for return of Keypad Code Count (0x0044)
     while (!keypadCodeCountReceived) {
       #ifndef NUKI_64BIT_TIME
-      if (millis() - timeNow > GENERAL_TIMEOUT) {
+      uint32_t elapsed = millis() - timeNow;
       #else
-      if ((esp_timer_get_time() / 1000) - timeNow > GENERAL_TIMEOUT) {
+      uint32_t elapsed = (esp_timer_get_time() / 1000) - timeNow;
       #endif
+      if (elapsed > getCommandTimeout(Command::KeypadCodeCount)) {
         logMessage("Receive keypad count timeout", 2);
         disconnect();
         return CmdResult::TimeOut;
       }
-      delay(10);
+      #ifndef NUKI_NO_WDT_RESET
+      esp_task_wdt_reset();
+      #endif
+      waitForResponse(getCommandTimeout(Command::KeypadCodeCount) - elapsed);
     }
     if (debugNukiCommand) {
       logMessageVar("Keypad code count %d", getKeypadEntryCount());
@@ -613,18 +1685,22 @@ Nuki::CmdResult NukiBle::retrieveKeypadEntries(const uint16_t offset, const uint
     #endif
     while (nrOfReceivedKeypadCodes < getKeypadEntryCount()) {
       #ifndef NUKI_64BIT_TIME
-      if (millis() - timeNow > GENERAL_TIMEOUT) {
+      uint32_t elapsed = millis() - timeNow;
       #else
-      if ((esp_timer_get_time() / 1000) - timeNow > GENERAL_TIMEOUT) {
+      uint32_t elapsed = (esp_timer_get_time() / 1000) - timeNow;
       #endif
+      if (elapsed > getCommandTimeout(Command::KeypadCode)) {
         logMessage("Receive keypadcodes timeout", 2);
         disconnect();
         return CmdResult::TimeOut;
       }
-      delay(10);
+      #ifndef NUKI_NO_WDT_RESET
+      esp_task_wdt_reset();
+      #endif
+      waitForResponse(getCommandTimeout(Command::KeypadCode) - elapsed);
     }
     if (debugNukiCommand) {
-      logMessageVar("%d codes received", nrOfReceivedKeypadCodes);
+      logMessageVar("%d codes received", nrOfReceivedKeypadCodes.load());
     }
   } else {
     logMessage("Retrieve keypad codes from lock failed", 2);
@@ -706,22 +1782,30 @@ Nuki::CmdResult NukiBle::updateKeypadEntry(UpdatedKeypadEntry updatedKeyPadEntry
 
 void NukiBle::getFingerprintEntries(std::list<FingerprintEntry>* requestedFingerprintEntries) {
   requestedFingerprintEntries->clear();
-  std::list<FingerprintEntry>::iterator it = listOfFingerprintEntries.begin();
+  auto it = listOfFingerprintEntries.begin();
   while (it != listOfFingerprintEntries.end()) {
     requestedFingerprintEntries->push_back(*it);
     it++;
   }
 }
 
+const EntryBuffer<FingerprintEntry>& NukiBle::getFingerprintEntries() const {
+  return listOfFingerprintEntries;
+}
+
 void NukiBle::getKeypadEntries(std::list<KeypadEntry>* requestedKeypadCodes) {
   requestedKeypadCodes->clear();
-  std::list<KeypadEntry>::iterator it = listOfKeyPadEntries.begin();
+  auto it = listOfKeyPadEntries.begin();
   while (it != listOfKeyPadEntries.end()) {
     requestedKeypadCodes->push_back(*it);
     it++;
   }
 }
 
+const EntryBuffer<KeypadEntry, NUKI_KEYPAD_ENTRY_CAPACITY>& NukiBle::getKeypadEntries() const {
+  return listOfKeyPadEntries;
+}
+
 uint16_t NukiBle::getKeypadEntryCount() {
   return nrOfKeypadCodes;
 }
@@ -739,18 +1823,19 @@ CmdResult NukiBle::deleteKeypadEntry(uint16_t id) {
   return executeAction(action);
 }
 
-Nuki::CmdResult NukiBle::retrieveFingerprintEntries() {
+Nuki::CmdResult NukiBle::retrieveFingerprintEntries(FingerprintEntryCallback callback) {
   NukiLock::Action action;
 
   action.cmdType = Nuki::CommandType::CommandWithChallengeAndPin;
   action.command = Command::RequestFingerprintEntries;
 
   listOfFingerprintEntries.clear();
+  fingerprintEntryCallback = callback;
 
   return executeAction(action);
 }
 
-Nuki::CmdResult NukiBle::retrieveAuthorizationEntries(const uint16_t offset, const uint16_t count) {
+Nuki::CmdResult NukiBle::retrieveAuthorizationEntries(const uint16_t offset, const uint16_t count, AuthorizationEntryCallback callback) {
   NukiLock::Action action;
   unsigned char payload[4] = {0};
   memcpy(payload, &offset, 2);
@@ -762,19 +1847,24 @@ Nuki::CmdResult NukiBle::retrieveAuthorizationEntries(const uint16_t offset, con
   action.payloadLen = sizeof(payload);
 
   listOfAuthorizationEntries.clear();
+  authorizationEntryCallback = callback;
 
   return executeAction(action);
 }
 
 void NukiBle::getAuthorizationEntries(std::list<AuthorizationEntry>* requestedAuthorizationEntries) {
   requestedAuthorizationEntries->clear();
-  std::list<AuthorizationEntry>::iterator it = listOfAuthorizationEntries.begin();
+  auto it = listOfAuthorizationEntries.begin();
   while (it != listOfAuthorizationEntries.end()) {
     requestedAuthorizationEntries->push_back(*it);
     it++;
   }
 }
 
+const EntryBuffer<AuthorizationEntry, NUKI_AUTHORIZATION_ENTRY_CAPACITY>& NukiBle::getAuthorizationEntries() const {
+  return listOfAuthorizationEntries;
+}
+
 Nuki::CmdResult NukiBle::addAuthorizationEntry(NewAuthorizationEntry newAuthorizationEntry) {
   //TODO verify data validity
   NukiLock::Action action;
@@ -965,6 +2055,10 @@ bool NukiBle::saveUltraPincode(const uint32_t pinCode, bool save) {
 }
 
 void NukiBle::saveCredentials() {
+  saveCredentials(preferences);
+}
+
+void NukiBle::saveCredentials(Preferences& store) {
   unsigned char currentBleAddress[6];
   unsigned char storedBleAddress[6];
   uint16_t defaultPincode = 0;
@@ -983,25 +2077,25 @@ void NukiBle::saveCredentials() {
   currentBleAddress[4] = bleAddress.getNative()[1];
   currentBleAddress[5] = bleAddress.getNative()[0];
   #endif
-  preferences.getBytes(BLE_ADDRESS_STORE_NAME, storedBleAddress, 6);
+  store.getBytes(BLE_ADDRESS_STORE_NAME, storedBleAddress, 6);
 
-  preferences.putBool(ULTRA_STORE_NAME, isLockUltra());
+  store.putBool(ULTRA_STORE_NAME, isLockUltra());
 
   if (isLockUltra()) {
-    preferences.putBytes(ULTRA_PINCODE_STORE_NAME, &ultraPinCode, 4);
+    store.putBytes(ULTRA_PINCODE_STORE_NAME, &ultraPinCode, 4);
   } else {
     if (compareCharArray(currentBleAddress, storedBleAddress, 6)) {
       //only store earlier retreived pin code if address is the same
       //otherwise it is a different/new lock
-      preferences.putBytes(SECURITY_PINCODE_STORE_NAME, &pinCode, 2);
+      store.putBytes(SECURITY_PINCODE_STORE_NAME, &pinCode, 2);
     } else {
-      preferences.putBytes(SECURITY_PINCODE_STORE_NAME, &defaultPincode, 2);
+      store.putBytes(SECURITY_PINCODE_STORE_NAME, &defaultPincode, 2);
     }
   }
 
-  if ((preferences.putBytes(BLE_ADDRESS_STORE_NAME, currentBleAddress, 6) == 6)
-      && (preferences.putBytes(SECRET_KEY_STORE_NAME, secretKeyK, 32) == 32)
-      && (preferences.putBytes(AUTH_ID_STORE_NAME, authorizationId, 4) == 4)
+  if ((store.putBytes(BLE_ADDRESS_STORE_NAME, currentBleAddress, 6) == 6)
+      && (store.putBytes(SECRET_KEY_STORE_NAME, secretKeyK, 32) == 32)
+      && (store.putBytes(AUTH_ID_STORE_NAME, authorizationId, 4) == 4)
      ) {
     if (debugNukiConnect) {
       logMessage("Credentials saved:");
@@ -1095,6 +2189,7 @@ void NukiBle::deleteCredentials() {
   preferences.putBytes(SECRET_KEY_STORE_NAME, emptySecretKeyK, 32);
   preferences.putBytes(AUTH_ID_STORE_NAME, emptyAuthorizationId, 4);
   preferences.putBool(ULTRA_STORE_NAME, false);
+  deleteGattCache();
   // preferences.remove(SECRET_KEY_STORE_NAME);
   // preferences.remove(AUTH_ID_STORE_NAME);
 
@@ -1226,7 +2321,8 @@ PairingState NukiBle::pairStateMachine(const PairingState nukiPairingState) {
           authorizationDataId[2] = (deviceId >> (8 * 2)) & 0xff;
           authorizationDataId[3] = (deviceId >> (8 * 3)) & 0xff;
           memcpy(authorizationDataName, deviceName.c_str(), deviceName.size());
-          generateNonce(authorizationDataNonce, sizeof(authorizationDataNonce), debugNukiHexData);
+          takeNonce(authorizationDataNonce, sizeof(authorizationDataNonce));
+          printBuffer((byte*)authorizationDataNonce, sizeof(authorizationDataNonce), false, "Nonce", debugNukiHexData, logger);
 
           //calculate authenticator of message to send
           memcpy(&authorizationData[0], authorizationDataIdType, sizeof(authorizationDataIdType));
@@ -1300,16 +2396,56 @@ PairingState NukiBle::pairStateMachine(const PairingState nukiPairingState) {
 }
 
 bool NukiBle::sendEncryptedMessage(Command commandIdentifier, const unsigned char* payload, const uint8_t payloadLen) {
+  int frameLen = buildEncryptedFrame(commandIdentifier, payload, payloadLen);
+
+  if (frameLen >= 0) {
+    if(encryptPairing) {
+      if (connectBle(bleAddress, true)) {
+        printBuffer((byte*)txFrame, frameLen, false, "Sending encrypted pairing message", debugNukiHexData, logger);
+        encryptPairing = false;
+        recieveEncrypted = true;
+        return pGdioCharacteristic->writeValue(txFrame, frameLen, true);
+      } else {
+        logMessage("Send encr msg failed due to unable to connect", 2);
+      }
+    } else {
+      if (connectBle(bleAddress, false)) {
+        printBuffer((byte*)txFrame, frameLen, false, "Sending encrypted message", debugNukiHexData, logger);
+        if (usdioCachedActive) {
+          if (writeCachedHandle(gattCache.usdioValueHandle, txFrame, frameLen)) {
+            return true;
+          }
+          if (cachedWriteStatus != BLE_HS_ENOMEM) {
+            return false;
+          }
+          //no mbufs for a long write on the cached handle, write through the discovered characteristic
+          usdioCachedActive = false;
+          if (!registerOnUsdioChar()) {
+            return false;
+          }
+        }
+        return pUsdioCharacteristic->writeValue(txFrame, frameLen, true);
+      } else {
+        logMessage("Send encr msg failed due to unable to connect", 2);
+      }
+    }
+  } else {
+    logMessage("Send msg failed due to encryption fail", 2);
+  }
+  return false;
+}
+
+int NukiBle::buildEncryptedFrame(Command commandIdentifier, const unsigned char* payload, const uint8_t payloadLen) {
   /*
   #     ADDITIONAL DATA (not encr)      #                    PLAIN DATA (encr)                             #
   #  nonce  # auth identifier # msg len # authorization identifier # command identifier # payload #  crc   #
   # 24 byte #    4 byte       # 2 byte  #      4 byte              #       2 byte       #  n byte # 2 byte #
   */
+  uint8_t* nonce = &txFrame[0];
+  uint8_t* plainData = &txFrame[30];
+  uint16_t plainDataLen = 8 + payloadLen;
 
   //compose plain data
-  unsigned char plainData[6 + payloadLen] = {};
-  unsigned char plainDataWithCrc[8 + payloadLen] = {};
-
   if(encryptPairing) {
     plainData[0] = (deviceId >> (8 * 0)) & 0xff;
     plainData[1] = (deviceId >> (8 * 1)) & 0xff;
@@ -1319,107 +2455,72 @@ bool NukiBle::sendEncryptedMessage(Command commandIdentifier, const unsigned cha
     memcpy(&plainData[0], &authorizationId, sizeof(authorizationId));
   }
   memcpy(&plainData[4], &commandIdentifier, sizeof(commandIdentifier));
-  memcpy(&plainData[6], payload, payloadLen);
+  if (payload != &txFrame[NUKI_TX_PAYLOAD_OFFSET]) {
+    memcpy(&plainData[6], payload, payloadLen);
+  }
 
   //get crc over plain data
-  uint16_t dataCrc = calculateCrc((uint8_t*)plainData, 0, sizeof(plainData));
-
-  memcpy(&plainDataWithCrc[0], &plainData, sizeof(plainData));
-  memcpy(&plainDataWithCrc[sizeof(plainData)], &dataCrc, sizeof(dataCrc));
+  uint16_t dataCrc = calculateCrc(plainData, 0, plainDataLen - 2);
+  memcpy(&plainData[plainDataLen - 2], &dataCrc, sizeof(dataCrc));
 
   if (debugNukiHexData) {
     logMessageVar("payloadlen: %d", payloadLen);
-    logMessageVar("sizeof(plainData): %d", sizeof(plainData));
+    logMessageVar("sizeof(plainData): %d", plainDataLen - 2);
     logMessageVar("CRC: %0.2x", dataCrc);
   }
-  printBuffer((byte*)plainDataWithCrc, sizeof(plainDataWithCrc), false, "Plain data with CRC: ", debugNukiHexData, logger);
+  printBuffer((byte*)plainData, plainDataLen, false, "Plain data with CRC: ", debugNukiHexData, logger);
 
-  //compose additional data
-  unsigned char additionalData[30] = {};
-  generateNonce(sentNonce, sizeof(sentNonce), debugNukiHexData);
+  //compose additional data, the auth identifier is the same as in the plain data
+  takeNonce(nonce, crypto_secretbox_NONCEBYTES);
+  printBuffer((byte*)nonce, crypto_secretbox_NONCEBYTES, false, "Nonce", debugNukiHexData, logger);
+  memcpy(&txFrame[24], plainData, 4);
+  int16_t length = plainDataLen + crypto_secretbox_MACBYTES;
+  memcpy(&txFrame[28], &length, 2);
 
-  memcpy(&additionalData[0], sentNonce, sizeof(sentNonce));
-
-  if(encryptPairing) {
-    additionalData[24] = (deviceId >> (8 * 0)) & 0xff;
-    additionalData[25] = (deviceId >> (8 * 1)) & 0xff;
-    additionalData[26] = (deviceId >> (8 * 2)) & 0xff;
-    additionalData[27] = (deviceId >> (8 * 3)) & 0xff;
-  } else {
-    memcpy(&additionalData[24], authorizationId, sizeof(authorizationId));
+  //Encrypt plain data in place
+  if (encode(plainData, plainData, plainDataLen, nonce, secretKeyK, logger) < 0) {
+    return -1;
   }
 
-  //Encrypt plain data
-  unsigned char plainDataEncr[ sizeof(plainDataWithCrc) + crypto_secretbox_MACBYTES] = {0};
-  int encrMsgLen = encode(plainDataEncr, plainDataWithCrc, sizeof(plainDataWithCrc), sentNonce, secretKeyK, logger);
-
-  if (encrMsgLen >= 0) {
-    int16_t length = sizeof(plainDataEncr);
-    memcpy(&additionalData[28], &length, 2);
-
-    printBuffer((byte*)additionalData, 30, false, "Additional data: ", debugNukiHexData, logger);
-    printBuffer((byte*)secretKeyK, sizeof(secretKeyK), false, "Encryption key (secretKey): ", debugNukiHexData, logger);
-    printBuffer((byte*)plainDataEncr, sizeof(plainDataEncr), false, "Plain data encrypted: ", debugNukiHexData, logger);
+  printBuffer((byte*)txFrame, 30, false, "Additional data: ", debugNukiHexData, logger);
+  printBuffer((byte*)secretKeyK, sizeof(secretKeyK), false, "Encryption key (secretKey): ", debugNukiHexData, logger);
+  printBuffer((byte*)plainData, length, false, "Plain data encrypted: ", debugNukiHexData, logger);
+  return 30 + length;
+}
 
-    //compose complete message
-    unsigned char dataToSend[sizeof(additionalData) + sizeof(plainDataEncr)] = {};
-    memcpy(&dataToSend[0], additionalData, sizeof(additionalData));
-    memcpy(&dataToSend[30], plainDataEncr, sizeof(plainDataEncr));
+bool NukiBle::sendPlainMessage(Command commandIdentifier, const unsigned char* payload, const uint8_t payloadLen) {
+  uint16_t frameLen = buildPlainFrame(commandIdentifier, payload, payloadLen);
 
-    if(encryptPairing) {
-      if (connectBle(bleAddress, true)) {
-        printBuffer((byte*)dataToSend, sizeof(dataToSend), false, "Sending encrypted pairing message", debugNukiHexData, logger);
-        encryptPairing = false;
-        recieveEncrypted = true;
-        return pGdioCharacteristic->writeValue((uint8_t*)dataToSend, sizeof(dataToSend), true);
-      } else {
-        logMessage("Send encr msg failed due to unable to connect", 2);
-      }
-    } else {
-      if (connectBle(bleAddress, false)) {
-        printBuffer((byte*)dataToSend, sizeof(dataToSend), false, "Sending encrypted message", debugNukiHexData, logger);
-        return pUsdioCharacteristic->writeValue((uint8_t*)dataToSend, sizeof(dataToSend), true);
-      } else {
-        logMessage("Send encr msg failed due to unable to connect", 2);
-      }
-    }
+  if (connectBle(bleAddress, true)) {
+    return pGdioCharacteristic->writeValue(txFrame, frameLen, true);
   } else {
-    logMessage("Send msg failed due to encryption fail", 2);
+    logMessage("Send plain msg failed due to unable to connect", 2);
   }
   return false;
 }
 
-bool NukiBle::sendPlainMessage(Command commandIdentifier, const unsigned char* payload, const uint8_t payloadLen) {
+uint16_t NukiBle::buildPlainFrame(Command commandIdentifier, const unsigned char* payload, const uint8_t payloadLen) {
   /*
   #                PLAIN DATA                   #
   #command identifier  #   payload   #   crc    #
   #      2 byte        #   n byte    #  2 byte  #
   */
+  memcpy(&txFrame[0], &commandIdentifier, sizeof(commandIdentifier));
+  memcpy(&txFrame[2], payload, payloadLen);
+  uint16_t dataCrc = calculateCrc(txFrame, 0, payloadLen + 2);
+  memcpy(&txFrame[2 + payloadLen], &dataCrc, sizeof(dataCrc));
 
-  //compose data
-  char dataToSend[200];
-  memcpy(&dataToSend, &commandIdentifier, sizeof(commandIdentifier));
-  memcpy(&dataToSend[2], payload, payloadLen);
-  uint16_t dataCrc = calculateCrc((uint8_t*)dataToSend, 0, payloadLen + 2);
-
-  memcpy(&dataToSend[2 + payloadLen], &dataCrc, sizeof(dataCrc));
-  printBuffer((byte*)dataToSend, payloadLen + 4, false, "Sending plain message", debugNukiHexData, logger);
+  printBuffer((byte*)txFrame, payloadLen + 4, false, "Sending plain message", debugNukiHexData, logger);
   if (debugNukiHexData) {
     if (logger == nullptr) {
       log_d("Command identifier: %02x, CRC: %04x", (uint32_t)commandIdentifier, dataCrc);
     }
     else
     {
-      logger->printf("Command identifier: %02x, CRC: %04x\r\n", (uint32_t)commandIdentifier, dataCrc);
-    }
-  }
-
-  if (connectBle(bleAddress, true)) {
-    return pGdioCharacteristic->writeValue((uint8_t*)dataToSend, payloadLen + 4, true);
-  } else {
-    logMessage("Send plain msg failed due to unable to connect", 2);
+      logger->printf("Command identifier: %02x, CRC: %04x\r\n", (uint32_t)commandIdentifier, dataCrc);
+    }
   }
-  return false;
+  return payloadLen + 4;
 }
 
 bool NukiBle::registerOnGdioChar() {
@@ -1503,6 +2604,8 @@ bool NukiBle::registerOnUsdioChar() {
         if (debugNukiCommunication) {
           logMessage("USDIO characteristic registered");
         }
+        gattDiscovered = true;
+        saveGattCache();
         delay(100);
         return true;
       } else {
@@ -1529,71 +2632,668 @@ bool NukiBle::registerOnUsdioChar() {
   return false;
 }
 
+bool NukiBle::registerOnCachedUsdioHandle() {
+  //handles discovered earlier in this session are cached by NimBLE itself
+  if (!gattCacheEnabled || !gattCacheValid || gattDiscovered) {
+    return false;
+  }
+
+  const uint8_t enableIndications[2] = {0x02, 0x00};
+  usdioCachedActive = true;
+
+  if (!writeCachedHandle(gattCache.usdioCccdHandle, enableIndications, sizeof(enableIndications))) {
+    usdioCachedActive = false;
+    logMessage("Unable to subscribe on cached USDIO handle, using service discovery", 2);
+    return false;
+  }
+
+  if (debugNukiCommunication) {
+    logMessage("USDIO characteristic registered on cached handle");
+  }
+  return true;
+}
+
+bool NukiBle::writeCachedHandle(uint16_t handle, const uint8_t* data, uint16_t length) {
+  uint16_t connHandle = getConnHandle();
+  int rc = 0;
+  cachedWriteStatus = -1;
+  xEventGroupClearBits(connectionEvents, CACHED_WRITE_DONE_BIT);
+
+  if (length > ble_att_mtu(connHandle) - 3) {
+    os_mbuf* om = ble_hs_mbuf_from_flat(data, length);
+    if (om == nullptr) {
+      //out of mbufs, the caller falls back to the characteristic write
+      logMessage("Write on cached handle failed: no mbuf available", 2);
+      cachedWriteStatus = BLE_HS_ENOMEM;
+      return false;
+    }
+    rc = ble_gattc_write_long(connHandle, handle, 0, om, onCachedHandleWritten, this);
+  } else {
+    rc = ble_gattc_write_flat(connHandle, handle, data, length, onCachedHandleWritten, this);
+  }
+
+  if (rc != 0) {
+    logMessageVar("Write on cached handle failed: %d", (unsigned int)rc, 2);
+    cachedWriteStatus = rc;
+    return false;
+  }
+
+  EventBits_t bits = xEventGroupWaitBits(connectionEvents, CACHED_WRITE_DONE_BIT, pdTRUE, pdTRUE, pdMS_TO_TICKS(GENERAL_TIMEOUT));
+  if ((bits & CACHED_WRITE_DONE_BIT) == 0) {
+    logMessage("Write on cached handle timeout", 2);
+    return false;
+  }
+
+  if (cachedWriteStatus >= BLE_HS_ERR_ATT_BASE) {
+    //attribute error, the handle is not (or no longer) valid on the lock
+    logMessageVar("Cached handle rejected by lock: %d", (unsigned int)cachedWriteStatus, 2);
+    gattCacheValid = false;
+    deleteGattCache();
+  }
+  return cachedWriteStatus == 0;
+}
+
+int NukiBle::onCachedHandleWritten(uint16_t connHandle, const ble_gatt_error* error, ble_gatt_attr* attr, void* arg) {
+  NukiBle* nukiBle = (NukiBle*)arg;
+  nukiBle->cachedWriteStatus = error->status;
+  xEventGroupSetBits(nukiBle->connectionEvents, CACHED_WRITE_DONE_BIT);
+  return 0;
+}
+
+int NukiBle::onGapEvent(ble_gap_event* event, void* arg) {
+  NukiBle* nukiBle = (NukiBle*)arg;
+
+  if (event->type == BLE_GAP_EVENT_NOTIFY_RX && nukiBle->usdioCachedActive
+      && event->notify_rx.attr_handle == nukiBle->gattCache.usdioValueHandle
+      && event->notify_rx.conn_handle == nukiBle->getConnHandle()) {
+    RxFrame* frame = nukiBle->reserveRxFrame(OS_MBUF_PKTLEN(event->notify_rx.om));
+    if (frame != nullptr) {
+      frame->channel = RxChannel::Usdio;
+      ble_hs_mbuf_to_flat(event->notify_rx.om, frame->data, sizeof(frame->data), &frame->length);
+      nukiBle->commitRxFrame();
+    }
+  }
+  return 0;
+}
+
+uint16_t NukiBle::getConnHandle() {
+  //the device manager may take the client from another task, read it once
+  BLEClient* client = pClient;
+  if (client == nullptr) {
+    return BLE_HS_CONN_HANDLE_NONE;
+  }
+
+  #ifdef NUKI_USE_LATEST_NIMBLE
+  return client->getConnHandle();
+  #else
+  return client->getConnId();
+  #endif
+}
+
+void NukiBle::loadGattCache() {
+  unsigned char storedBleAddress[6] = {0};
+  gattCacheValid = false;
+  gattDiscovered = false;
+
+  if ((preferences.getBytes(GATT_CACHE_STORE_NAME, &gattCache, sizeof(GattHandleCache)) == sizeof(GattHandleCache))
+      && (preferences.getBytes(BLE_ADDRESS_STORE_NAME, storedBleAddress, 6) == 6)) {
+    gattCacheValid = compareCharArray(gattCache.bleAddress, storedBleAddress, 6)
+                     && gattCache.usdioValueHandle != 0 && gattCache.usdioCccdHandle != 0;
+  }
+
+  if (debugNukiConnect && gattCacheValid) {
+    logMessageVar("GATT cache retrieved, USDIO handle: %d", gattCache.usdioValueHandle);
+  }
+}
+
+void NukiBle::saveGattCache() {
+  if (!gattCacheEnabled || pUsdioCharacteristic == nullptr) {
+    return;
+  }
+
+  NimBLERemoteDescriptor* pCccd = pUsdioCharacteristic->getDescriptor(NimBLEUUID((uint16_t)0x2902));
+  if (pCccd == nullptr) {
+    return;
+  }
+
+  GattHandleCache newCache;
+  preferences.getBytes(BLE_ADDRESS_STORE_NAME, newCache.bleAddress, 6);
+  memcpy(newCache.firmwareVersion, lockFirmwareVersion, sizeof(newCache.firmwareVersion));
+  newCache.usdioValueHandle = pUsdioCharacteristic->getHandle();
+  newCache.usdioCccdHandle = pCccd->getHandle();
+
+  if (gattCacheValid && memcmp(&newCache, &gattCache, sizeof(GattHandleCache)) == 0) {
+    return;
+  }
+
+  if (preferences.putBytes(GATT_CACHE_STORE_NAME, &newCache, sizeof(GattHandleCache)) == sizeof(GattHandleCache)) {
+    memcpy(&gattCache, &newCache, sizeof(GattHandleCache));
+    gattCacheValid = true;
+    if (debugNukiConnect) {
+      logMessageVar("GATT cache saved, USDIO handle: %d", gattCache.usdioValueHandle);
+    }
+  }
+}
+
+void NukiBle::deleteGattCache() {
+  GattHandleCache emptyCache;
+  preferences.putBytes(GATT_CACHE_STORE_NAME, &emptyCache, sizeof(GattHandleCache));
+  gattCacheValid = false;
+}
+
+void NukiBle::updateGattCacheFirmwareVersion(const unsigned char* firmwareVersion) {
+  memcpy(lockFirmwareVersion, firmwareVersion, sizeof(lockFirmwareVersion));
+
+  if (!gattCacheValid || compareCharArray(gattCache.firmwareVersion, lockFirmwareVersion, sizeof(lockFirmwareVersion))) {
+    return;
+  }
+
+  if (isCharArrayEmpty(gattCache.firmwareVersion, sizeof(gattCache.firmwareVersion))) {
+    //firmware version was not known yet when the handles were cached
+    memcpy(gattCache.firmwareVersion, lockFirmwareVersion, sizeof(lockFirmwareVersion));
+    preferences.putBytes(GATT_CACHE_STORE_NAME, &gattCache, sizeof(GattHandleCache));
+  } else {
+    //handles could have changed with a firmware update
+    if (debugNukiConnect) {
+      logMessage("Lock firmware changed, GATT cache invalidated");
+    }
+    deleteGattCache();
+  }
+}
+
 void NukiBle::notifyCallback(BLERemoteCharacteristic* pBLERemoteCharacteristic, uint8_t* recData, size_t length, bool isNotify) {
-  delay(100);
+  //runs on the NimBLE host task, only queue the indication and let the protocol worker task handle it
+  RxChannel channel;
+  const NimBLEUUID& charUUID = pBLERemoteCharacteristic->getUUID();
+
+  if (charUUID == gdioUUID) {
+    channel = RxChannel::Gdio;
+  } else if (charUUID == gdioUltraUUID) {
+    channel = RxChannel::GdioUltra;
+  } else if (charUUID == userDataUUID) {
+    channel = RxChannel::Usdio;
+  } else {
+    return;
+  }
+
+  RxFrame* frame = reserveRxFrame(length);
+  if (frame != nullptr) {
+    frame->channel = channel;
+    frame->length = length;
+    memcpy(frame->data, recData, length);
+    commitRxFrame();
+  }
+}
+
+NukiBle::RxFrame* NukiBle::reserveRxFrame(size_t length) {
+  if (length > NUKI_RX_FRAME_SIZE) {
+    rxQueue.drop();
+    return nullptr;
+  }
+  return rxQueue.reserve();
+}
+
+void NukiBle::commitRxFrame() {
+  rxQueue.commit();
+
+  if (rxTaskHandle != nullptr) {
+    xTaskNotifyGive(rxTaskHandle);
+  }
+}
+
+void NukiBle::takeNonce(uint8_t* nonce, const size_t len) {
+  nonceProvider->fill(nonce, len);
+  //the protocol task tops up the pool right away, so the next send (ie in a batch) finds it full again
+  if (rxTaskHandle != nullptr) {
+    xTaskNotifyGive(rxTaskHandle);
+  }
+}
+
+void NukiBle::rxTask(void* pvParameters) {
+  NukiBle* nukiBle = (NukiBle*)pvParameters;
+
+  while (true) {
+    //a command in progress is stepped on every received message, the timeout only serves the command timeouts,
+    //the nonce pool is topped up after every received message and every nonce taken
+    ulTaskNotifyTake(pdTRUE, nukiBle->asyncCommandPending ? pdMS_TO_TICKS(ASYNC_CMD_POLL_INTERVAL) : portMAX_DELAY);
+    nukiBle->processRxQueue();
+    nukiBle->stepAsyncCommand();
+    nukiBle->nonceProvider->refill();
+  }
+}
+
+void NukiBle::processRxQueue() {
+  RxFrame* frame;
+
+  while ((frame = rxQueue.front()) != nullptr) {
+    Command received = Command::Empty;
+    switch (frame->channel) {
+      case RxChannel::Gdio:
+        received = handleIndication(gdioUUID, frame->data, frame->length);
+        break;
+      case RxChannel::GdioUltra:
+        received = handleIndication(gdioUltraUUID, frame->data, frame->length);
+        break;
+      case RxChannel::Usdio:
+        received = handleIndication(userDataUUID, frame->data, frame->length);
+        break;
+    }
+
+    rxQueue.pop();
+    if (received != Command::Empty) {
+      //the state of the handled message is published before, the waiting command can evaluate it right away
+      xQueueOverwrite(responseQueue, &received);
+    }
+  }
+}
+
+bool NukiBle::checkPaired() {
+  if (isPairedWithLock()) {
+    return true;
+  }
+
+  if (debugNukiConnect) {
+    logMessage("************************ CHECK PAIRED ************************");
+  }
+  if (retrieveCredentials()) {
+    if (debugNukiConnect) {
+      logMessage("Credentials retrieved from preferences, ready for commands");
+    }
+    return true;
+  }
+
+  if (debugNukiConnect) {
+    logMessage("Credentials NOT retrieved from preferences, first pair with the lock");
+  }
+  return false;
+}
+
+Nuki::CmdResult NukiBle::stepProtocol(const Nuki::CommandType cmdType, const Command command,
+                                      const unsigned char* payload, const uint8_t payloadLen) {
+  extendDisconnectTimeout();
+
+  Nuki::CmdResult result = Nuki::CmdResult::Working;
+  if ((size_t)cmdType >= sizeof(protocolDescriptors) / sizeof(protocolDescriptors[0])) {
+    logMessage("Unknown cmd type", 2);
+    result = Nuki::CmdResult::Failed;
+  } else if (protocolStepIndex >= protocolDescriptors[(size_t)cmdType].stepCount) {
+    logMessage("Unknown request command state", 2);
+    result = Nuki::CmdResult::Failed;
+  } else {
+    const ProtocolStep step = protocolDescriptors[(size_t)cmdType].steps[protocolStepIndex];
+
+    switch (step) {
+      case ProtocolStep::SendRequest:
+      case ProtocolStep::SendChallengeRequest:
+      case ProtocolStep::SendCommand:
+      case ProtocolStep::SendCommandWithPin: {
+        bool sent;
+        lastMsgCodeReceived = Command::Empty;
+        xQueueReset(responseQueue);
+
+        if (step == ProtocolStep::SendChallengeRequest) {
+          if (debugNukiCommunication) {
+            logMessage("************************ SENDING CHALLENGE ************************");
+          }
+          unsigned char challenge[sizeof(Command)] = {0x04, 0x00};
+          sent = sendEncryptedMessage(Command::RequestData, challenge, sizeof(Command));
+        } else if (step == ProtocolStep::SendRequest) {
+          if (debugNukiCommunication) {
+            logMessageVar("************************ SENDING COMMAND [%d] ************************", (unsigned int)command);
+          }
+          sent = sendEncryptedMessage(Command::RequestData, payload, payloadLen);
+        } else {
+          if (debugNukiCommunication) {
+            logMessageVar("************************ SENDING COMMAND [%d] ************************", (unsigned int)command);
+          }
+          //add received challenge nonce and pincode to payload
+          uint8_t pinLen = 0;
+          if (step == ProtocolStep::SendCommandWithPin) {
+            pinLen = isLockUltra() ? 4 : 2;
+          }
+          uint8_t messageLen = payloadLen + sizeof(challengeNonceK) + pinLen;
+          //compose the message at its place in the frame instead of on the stack of the rx task
+          unsigned char* message = &txFrame[NUKI_TX_PAYLOAD_OFFSET];
+          memcpy(message, payload, payloadLen);
+          memcpy(&message[payloadLen], challengeNonceK, sizeof(challengeNonceK));
+          if (pinLen == 4) {
+            memcpy(&message[payloadLen + sizeof(challengeNonceK)], &ultraPinCode, 4);
+          } else if (pinLen == 2) {
+            memcpy(&message[payloadLen + sizeof(challengeNonceK)], &pinCode, 2);
+          }
+          sent = sendEncryptedMessage(command, message, messageLen);
+        }
+
+        if (sent) {
+          #ifndef NUKI_64BIT_TIME
+          timeNow = millis();
+          #else
+          timeNow = (esp_timer_get_time() / 1000);
+          #endif
+          stepTimeout = getStepTimeout(step == ProtocolStep::SendChallengeRequest ? Command::Challenge
+                                       : step == ProtocolStep::SendRequest ? Command::RequestData : command);
+          protocolStepIndex++;
+        } else {
+          if (debugNukiCommunication) {
+            logMessage("************************ SENDING COMMAND FAILED ************************");
+          }
+          result = Nuki::CmdResult::Failed;
+        }
+        break;
+      }
+      case ProtocolStep::AwaitChallenge:
+      case ProtocolStep::AwaitResponse:
+      case ProtocolStep::AwaitAccept: {
+        #ifndef NUKI_64BIT_TIME
+        uint32_t elapsed = millis() - timeNow;
+        #else
+        uint32_t elapsed = (esp_timer_get_time() / 1000) - timeNow;
+        #endif
+        if (elapsed > stepTimeout) {
+          logMessage("************************ COMMAND FAILED TIMEOUT ************************", 2);
+          result = Nuki::CmdResult::TimeOut;
+        } else if (lastMsgCodeReceived == Command::ErrorReport && errorCode == 69) {
+          if (debugNukiCommunication) {
+            logMessage("************************ COMMAND FAILED LOCK BUSY ************************");
+          }
+          result = Nuki::CmdResult::Lock_Busy;
+        } else if (lastMsgCodeReceived == Command::ErrorReport) {
+          if (debugNukiCommunication) {
+            logMessage("************************ COMMAND FAILED ************************");
+          }
+          result = Nuki::CmdResult::Failed;
+        } else if (step == ProtocolStep::AwaitChallenge && lastMsgCodeReceived == Command::Challenge) {
+          roundTrips.add(elapsed);
+          protocolStepIndex++;
+          lastMsgCodeReceived = Command::Empty;
+        } else if (step == ProtocolStep::AwaitResponse && lastMsgCodeReceived != Command::Empty) {
+          roundTrips.add(elapsed);
+          if (debugNukiCommunication) {
+            logMessage("************************ COMMAND DONE ************************");
+          }
+          result = Nuki::CmdResult::Success;
+        } else if (step == ProtocolStep::AwaitAccept && lastMsgCodeReceived == Command::Status
+                   && ((CommandStatus)receivedStatus.load() == CommandStatus::Accepted
+                       || (CommandStatus)receivedStatus.load() == CommandStatus::Complete)) {
+          //complete without accept when the lock skipped the action (ie unlock when already unlocked)
+          roundTrips.add(elapsed);
+          if (debugNukiCommunication) {
+            logMessage("************************ COMMAND ACCEPTED ************************");
+          }
+          result = Nuki::CmdResult::Success;
+        }
+        break;
+      }
+    }
+  }
+
+  if (result != Nuki::CmdResult::Working) {
+    protocolStepIndex = 0;
+    lastMsgCodeReceived = Command::Empty;
+    if (result != Nuki::CmdResult::Success) {
+      disconnect();
+    }
+  }
+  return result;
+}
+
+uint32_t NukiBle::getStepTimeLeft() const {
+  #ifndef NUKI_64BIT_TIME
+  uint32_t elapsed = millis() - timeNow;
+  #else
+  uint32_t elapsed = (esp_timer_get_time() / 1000) - timeNow;
+  #endif
+  return elapsed < stepTimeout ? stepTimeout - elapsed : 0;
+}
+
+Command NukiBle::waitForResponse(const uint32_t timeoutMs) {
+  Command received = Command::Empty;
+  //one tick more, so a wait that is not answered ends after the timeout and not just before it
+  xQueueReceive(responseQueue, &received, pdMS_TO_TICKS(timeoutMs) + 1);
+  return received;
+}
+
+bool NukiBle::claimCommandSlot(const uint32_t timeoutMs) {
+  #ifndef NUKI_64BIT_TIME
+  unsigned long start = millis();
+  #else
+  int64_t start = (esp_timer_get_time() / 1000);
+  #endif
+
+  while (true) {
+    //cleared before trying, so a release after a failed try is not missed
+    xEventGroupClearBits(connectionEvents, COMMAND_SLOT_FREE_BIT);
+    bool expected = false;
+    if (commandInProgress.compare_exchange_strong(expected, true)) {
+      return true;
+    }
+
+    #ifndef NUKI_64BIT_TIME
+    uint32_t elapsed = millis() - start;
+    #else
+    uint32_t elapsed = (esp_timer_get_time() / 1000) - start;
+    #endif
+    //a keep-alive is not visible to the caller, its single request is waited for regardless of the timeout
+    if (keepAliveRunning) {
+      xEventGroupWaitBits(connectionEvents, COMMAND_SLOT_FREE_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+      #ifndef NUKI_64BIT_TIME
+      start = millis() - elapsed;
+      #else
+      start = (esp_timer_get_time() / 1000) - elapsed;
+      #endif
+      continue;
+    }
+    if (elapsed >= timeoutMs) {
+      return false;
+    }
+    xEventGroupWaitBits(connectionEvents, COMMAND_SLOT_FREE_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeoutMs - elapsed));
+  }
+}
+
+void NukiBle::releaseCommandSlot() {
+  commandInProgress = false;
+  xEventGroupSetBits(connectionEvents, COMMAND_SLOT_FREE_BIT);
+}
+
+Nuki::CmdResult NukiBle::startAsyncCommand(CmdHandle command) {
+  if (rxTaskHandle == nullptr || connectTaskHandle == nullptr) {
+    logMessage("Async command submitted before initialize()", 2);
+    return Nuki::CmdResult::Failed;
+  }
 
+  if (!claimCommandSlot(0)) {
+    if (debugNukiCommunication) {
+      logMessage("Another command is in progress");
+    }
+    return Nuki::CmdResult::Busy;
+  }
+
+  //the connect task hands the command to the protocol task once connected
+  asyncCommand = command;
+  xTaskNotifyGive(connectTaskHandle);
+  return Nuki::CmdResult::Working;
+}
+
+void NukiBle::connectTask(void* pvParameters) {
+  NukiBle* nukiBle = (NukiBle*)pvParameters;
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    if (nukiBle->connectBle(nukiBle->bleAddress, false)) {
+      nukiBle->extendDisconnectTimeout();
+      nukiBle->asyncCommandPending = true;
+      xTaskNotifyGive(nukiBle->rxTaskHandle);
+    } else {
+      CmdHandle command = nukiBle->asyncCommand;
+      nukiBle->asyncCommand.reset();
+      nukiBle->releaseCommandSlot();
+      command->complete(Nuki::CmdResult::Failed);
+    }
+  }
+}
+
+void NukiBle::stepAsyncCommand() {
+  if (!asyncCommandPending) {
+    return;
+  }
+
+  Nuki::CmdResult result;
+  uint8_t previousStep;
+  do {
+    //step again as long as the protocol progresses without waiting for the lock
+    previousStep = protocolStepIndex;
+    result = asyncCommand->step();
+  } while (result == Nuki::CmdResult::Working && protocolStepIndex != previousStep);
+
+  if (result != Nuki::CmdResult::Working) {
+    CmdHandle command = asyncCommand;
+    asyncCommand.reset();
+    asyncCommandPending = false;
+    releaseCommandSlot();
+    command->complete(result);
+  }
+}
+
+AsyncCommand::AsyncCommand(CmdCallback callback)
+  : callback(callback),
+    result(Nuki::CmdResult::Working),
+    doneEvent(xEventGroupCreate())
+{}
+
+AsyncCommand::~AsyncCommand() {
+  vEventGroupDelete(doneEvent);
+}
+
+bool AsyncCommand::isDone() const {
+  return result != Nuki::CmdResult::Working;
+}
+
+Nuki::CmdResult AsyncCommand::getResult() const {
+  return result;
+}
+
+Nuki::CmdResult AsyncCommand::await(uint32_t timeoutMs) {
+  xEventGroupWaitBits(doneEvent, ASYNC_CMD_DONE_BIT, pdFALSE, pdTRUE,
+                      timeoutMs == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs));
+  return result;
+}
+
+void AsyncCommand::complete(const Nuki::CmdResult cmdResult) {
+  result = cmdResult;
+  step = nullptr;
+  xEventGroupSetBits(doneEvent, ASYNC_CMD_DONE_BIT);
+  if (callback) {
+    callback(cmdResult);
+  }
+}
+
+uint32_t NukiBle::getRxQueueDepth() const {
+  return rxQueue.getDepth();
+}
+
+uint32_t NukiBle::getRxQueueMaxDepth() const {
+  return rxQueue.getMaxDepth();
+}
+
+uint32_t NukiBle::getRxDroppedFrames() const {
+  return rxQueue.getDropped();
+}
+
+uint32_t NukiBle::getDroppedEntries() const {
+  return droppedEntries;
+}
+
+void NukiBle::entryDropped() {
+  droppedEntries++;
+  logMessage("Entry buffer full, entry dropped", 2);
+}
+
+Command NukiBle::handleIndication(const NimBLEUUID& charUUID, uint8_t* recData, size_t length) {
   #ifndef NUKI_64BIT_TIME
   lastHeartbeat = millis();
+  lastLinkActivity = millis();
   #else
   lastHeartbeat = (esp_timer_get_time() / 1000);
+  lastLinkActivity = (esp_timer_get_time() / 1000);
   #endif
   if (debugNukiCommunication) {
     if (logger == nullptr) {
-      log_d("Notify callback for characteristic: %s of length: %d", pBLERemoteCharacteristic->getUUID().toString().c_str(), length);
+      log_d("Notify callback for characteristic: %s of length: %d", charUUID.toString().c_str(), length);
     }
     else
     {
-      logger->printf("Notify callback for characteristic: %s of length: %d\r\n", pBLERemoteCharacteristic->getUUID().toString().c_str(), length);
+      logger->printf("Notify callback for characteristic: %s of length: %d\r\n", charUUID.toString().c_str(), length);
     }
   }
 
   printBuffer((byte*)recData, length, false, "Received data", debugNukiHexData, logger);
 
-  if (pBLERemoteCharacteristic->getUUID() == gdioUUID || (pBLERemoteCharacteristic->getUUID() == gdioUltraUUID && (!recieveEncrypted || length < 24))) {
+  if (charUUID == gdioUUID || (charUUID == gdioUltraUUID && (!recieveEncrypted || length < 24))) {
     //handle not encrypted msg
+    if (length < 4) {
+      logMessageVar("Invalid msg length: %d", length, 2);
+      crcCheckOke = false;
+      return Command::Empty;
+    }
     uint16_t returnCode = ((uint16_t)recData[1] << 8) | recData[0];
     crcCheckOke = crcValid(recData, length, debugNukiCommunication, logger);
     if (crcCheckOke) {
-      unsigned char plainData[200];
-      memcpy(plainData, &recData[2], length - 4);
-      handleReturnMessage((Command)returnCode, plainData, length - 4);
+      //the payload is handled in the rx frame, no copy needed
+      handleReturnMessage((Command)returnCode, &recData[2], length - 4);
+      return (Command)returnCode;
     }
-  } else if (pBLERemoteCharacteristic->getUUID() == userDataUUID || (pBLERemoteCharacteristic->getUUID() == gdioUltraUUID && recieveEncrypted)) {
-    if (pBLERemoteCharacteristic->getUUID() == gdioUltraUUID) {
+  } else if (charUUID == userDataUUID || (charUUID == gdioUltraUUID && recieveEncrypted)) {
+    if (charUUID == gdioUltraUUID) {
       recieveEncrypted = false;
     }
-    //handle encrypted msg
-    unsigned char recNonce[crypto_secretbox_NONCEBYTES];
-    unsigned char recAuthorizationId[4];
-    unsigned char recMsgLen[2];
-    memcpy(recNonce, &recData[0], crypto_secretbox_NONCEBYTES);
-    memcpy(recAuthorizationId, &recData[crypto_secretbox_NONCEBYTES], 4);
-    memcpy(recMsgLen, &recData[crypto_secretbox_NONCEBYTES + 4], 2);
+    //handle encrypted msg: nonce | authorization id | length | encrypted msg, decrypted in place in the rx frame
+    const size_t headerLen = crypto_secretbox_NONCEBYTES + 6;
     uint16_t encrMsgLen = 0;
-    memcpy(&encrMsgLen, recMsgLen, 2);
-    unsigned char encrData[encrMsgLen];
-    memcpy(&encrData, &recData[crypto_secretbox_NONCEBYTES + 6], encrMsgLen);
-
-    unsigned char decrData[encrMsgLen - crypto_secretbox_MACBYTES];
-    decode(decrData, encrData, encrMsgLen, recNonce, secretKeyK, logger);
+    if (length >= headerLen) {
+      memcpy(&encrMsgLen, &recData[crypto_secretbox_NONCEBYTES + 4], 2);
+    }
+    //the decrypted msg holds at least authorization id, command and crc
+    if (length < headerLen || encrMsgLen < crypto_secretbox_MACBYTES + 8 || encrMsgLen > length - headerLen) {
+      logMessageVar("Invalid encrypted msg length: %d", encrMsgLen, 2);
+      crcCheckOke = false;
+      return Command::Empty;
+    }
+    unsigned char* recNonce = recData;
+    unsigned char* encrData = &recData[headerLen];
 
     if (debugNukiCommunication) {
       logMessageVar("Received encrypted msg, len: %d", encrMsgLen);
     }
-    printBuffer(recNonce, sizeof(recNonce), false, "received nonce", debugNukiHexData, logger);
-    printBuffer(recAuthorizationId, sizeof(recAuthorizationId), false, "Received AuthorizationId", debugNukiHexData, logger);
-    printBuffer(encrData, sizeof(encrData), false, "Rec encrypted data", debugNukiHexData, logger);
-    printBuffer(decrData, sizeof(decrData), false, "Decrypted data", debugNukiHexData, logger);
+    printBuffer(recNonce, crypto_secretbox_NONCEBYTES, false, "received nonce", debugNukiHexData, logger);
+    printBuffer(&recData[crypto_secretbox_NONCEBYTES], 4, false, "Received AuthorizationId", debugNukiHexData, logger);
+    printBuffer(encrData, encrMsgLen, false, "Rec encrypted data", debugNukiHexData, logger);
 
-    crcCheckOke = crcValid(decrData, sizeof(decrData), debugNukiCommunication, logger);
+    if (decode(encrData, encrData, encrMsgLen, recNonce, secretKeyK, logger) < 0) {
+      crcCheckOke = false;
+      return Command::Empty;
+    }
+    unsigned char* decrData = encrData;
+    uint16_t decrMsgLen = encrMsgLen - crypto_secretbox_MACBYTES;
+    printBuffer(decrData, decrMsgLen, false, "Decrypted data", debugNukiHexData, logger);
+
+    crcCheckOke = crcValid(decrData, decrMsgLen, debugNukiCommunication, logger);
     if (crcCheckOke) {
       uint16_t returnCode = 0;
       memcpy(&returnCode, &decrData[4], 2);
-      unsigned char payload[sizeof(decrData) - 8];
-      memcpy(&payload, &decrData[6], sizeof(payload));
-      handleReturnMessage((Command)returnCode, payload, sizeof(payload));
+      handleReturnMessage((Command)returnCode, &decrData[6], decrMsgLen - 8);
+      return (Command)returnCode;
     }
   }
+  return Command::Empty;
+}
+
+const PayloadSize* NukiBle::findExpectedPayloadSize(const Command returnCode) const {
+  return findPayloadSize(payloadSizes, sizeof(payloadSizes) / sizeof(payloadSizes[0]), (uint16_t)returnCode);
+}
+
+PayloadStats NukiBle::getPayloadStats() const {
+  return payloadStats;
 }
 
 void NukiBle::handleReturnMessage(Command returnCode, unsigned char* data, uint16_t dataLen) {
@@ -1641,8 +3341,12 @@ void NukiBle::handleReturnMessage(Command returnCode, unsigned char* data, uint1
     case Command::AuthorizationEntry : {
       printBuffer((byte*)data, dataLen, false, "authorizationEntry", debugNukiHexData, logger);
       AuthorizationEntry authEntry;
-      memcpy(&authEntry, data, dataLen);
-      listOfAuthorizationEntries.push_back(authEntry);
+      decodeReturnPayload(returnCode, &authEntry, data, dataLen);
+      if (authorizationEntryCallback) {
+        authorizationEntryCallback(authEntry);
+      } else if (!listOfAuthorizationEntries.push_back(authEntry)) {
+        entryDropped();
+      }
       if (debugNukiReadableData) {
         NukiLock::logAuthorizationEntry(authEntry, true, logger);
       }
@@ -1651,6 +3355,10 @@ void NukiBle::handleReturnMessage(Command returnCode, unsigned char* data, uint1
     case Command::Status : {
       printBuffer((byte*)data, dataLen, false, "status", debugNukiHexData, logger);
       receivedStatus = data[0];
+      if (receivedStatus == 0) {
+        //a list (ie log entries) is terminated by status complete
+        logSyncComplete = true;
+      }
       if (debugNukiCommunication) {
         if (receivedStatus == 0) {
           logMessage("command COMPLETE");
@@ -1673,7 +3381,7 @@ void NukiBle::handleReturnMessage(Command returnCode, unsigned char* data, uint1
       {
         logger->printf("Error: %02x for command: %02x:%02x\r\n", data[0], data[2], data[1]);
       }
-      memcpy(&errorCode, &data[0], sizeof(errorCode));
+      errorCode = data[0];
       logErrorCode(data[0]);
       if ((uint8_t)data[0] == (uint8_t)0x21) {
         if (eventHandler) {
@@ -1739,8 +3447,12 @@ void NukiBle::handleReturnMessage(Command returnCode, unsigned char* data, uint1
     }
     case Command::FingerprintEntry : {
       FingerprintEntry fingerprintEntry;
-      memcpy(&fingerprintEntry, data, dataLen);
-      listOfFingerprintEntries.push_back(fingerprintEntry);
+      decodeReturnPayload(returnCode, &fingerprintEntry, data, dataLen);
+      if (fingerprintEntryCallback) {
+        fingerprintEntryCallback(fingerprintEntry);
+      } else if (!listOfFingerprintEntries.push_back(fingerprintEntry)) {
+        entryDropped();
+      }
 
       printBuffer((byte*)data, dataLen, false, "fingerprintEntry", debugNukiHexData, logger);
       if (debugNukiReadableData) {
@@ -1750,8 +3462,12 @@ void NukiBle::handleReturnMessage(Command returnCode, unsigned char* data, uint1
     }
     case Command::KeypadCode : {
       KeypadEntry keypadEntry;
-      memcpy(&keypadEntry, data, dataLen);
-      listOfKeyPadEntries.push_back(keypadEntry);
+      decodeReturnPayload(returnCode, &keypadEntry, data, dataLen);
+      if (keypadEntryCallback) {
+        keypadEntryCallback(keypadEntry);
+      } else if (!listOfKeyPadEntries.push_back(keypadEntry)) {
+        entryDropped();
+      }
       nrOfReceivedKeypadCodes++;
 
       printBuffer((byte*)data, dataLen, false, "keypadCode", debugNukiHexData, logger);
@@ -1783,7 +3499,17 @@ void NukiBle::onDisconnect(BLEClient*, int reason)
 void NukiBle::onDisconnect(BLEClient*)
 #endif
 {
-  countDisconnects = 0;
+  usdioRegistered = false;
+  usdioCachedActive = false;
+  disconnecting = false;
+  #ifndef NUKI_64BIT_TIME
+  lastLinkActivity = millis();
+  #else
+  lastLinkActivity = (esp_timer_get_time() / 1000);
+  #endif
+  if (connectionEvents != nullptr) {
+    xEventGroupSetBits(connectionEvents, DISCONNECTED_BIT);
+  }
   if (debugNukiConnect) {
     logMessage("BLE disconnected");
   }
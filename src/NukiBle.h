@@ -14,19 +14,66 @@
 #include "NimBLEDevice.h"
 #include "NukiConstants.h"
 #include "NukiDataTypes.h"
+#include "NukiPayloadDecoder.h"
+#include "NukiEntryBuffer.h"
+#include "NukiRoundTrip.h"
+#include "NukiRxQueue.h"
+#include "NukiNonceProvider.h"
 #include "Arduino.h"
 #include <Preferences.h>
 #include <esp_task_wdt.h>
 #include <BleInterfaces.h>
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
 #include <atomic>
+#include <functional>
+#include <memory>
 #include <string>
 #include <list>
 #include "sodium/crypto_secretbox.h"
 
 #define GENERAL_TIMEOUT 3000
 #define CMD_TIMEOUT 3000
+#define READ_CMD_TIMEOUT 2000
+#define NUKI_TIMEOUT_OVERRIDES 8
+#define RTT_SAMPLES 32
+#define RTT_MIN_SAMPLES 8
+#define ADAPTIVE_TIMEOUT_FACTOR 3.0f
+#define ADAPTIVE_TIMEOUT_FLOOR 500
+#define ADAPTIVE_TIMEOUT_CEILING 6000
+#define LOG_SYNC_PAGE_SIZE 20
+#define LOG_SYNC_MAX_PAGES 50
 #define PAIRING_TIMEOUT 30000
 #define HEARTBEAT_TIMEOUT 30000
+#define KEEP_ALIVE_INTERVAL 10000
+#define RECONNECT_INTERVAL 2000
+#define DISCONNECT_TIMEOUT 5000
+#define CACHED_WRITE_DONE_BIT (1 << 0)
+#define DISCONNECTED_BIT (1 << 1)
+#define COMMAND_SLOT_FREE_BIT (1 << 2)
+#define COMMAND_SLOT_TIMEOUT 10000
+
+//power of two
+#ifndef NUKI_RX_QUEUE_SIZE
+#define NUKI_RX_QUEUE_SIZE 8
+#endif
+#define NUKI_RX_FRAME_SIZE 256
+//additional data (30) + authorization id, command, crc (8) + max payload (255) + mac
+#define NUKI_TX_FRAME_SIZE (30 + 8 + 255 + crypto_secretbox_MACBYTES)
+//offset of the payload in the frame, a payload composed there is not copied again
+#define NUKI_TX_PAYLOAD_OFFSET (30 + 6)
+#define NUKI_RX_TASK_STACK_SIZE 8192
+#define NUKI_RX_TASK_PRIORITY 5
+#define NUKI_CONNECT_TASK_STACK_SIZE 4096
+#define ASYNC_CMD_POLL_INTERVAL 50
+#define CONN_PROFILE_FALLBACK_FAILURES 3
+#define AUTO_REFRESH_DEBOUNCE 2000
+#define KEY_PAIR_TASK_STACK_SIZE 4096
+#define KEY_PAIR_TASK_PRIORITY 1
+#define KEY_PAIR_REFRESH_INTERVAL 600000
+#define NUKI_PROVISION_QUEUE_SIZE 16
+#define PROVISION_STALE_TIMEOUT 10000
+#define ASYNC_CMD_DONE_BIT (1 << 0)
 
 #ifdef CONFIG_IDF_TARGET_ESP32P4
 typedef enum {
@@ -52,6 +99,54 @@ typedef enum {
 #endif
 
 namespace Nuki {
+
+class NukiDeviceManager;
+
+typedef std::function<void(const Nuki::CmdResult result)> CmdCallback;
+typedef std::function<void(const KeypadEntry& entry)> KeypadEntryCallback;
+typedef std::function<void(const FingerprintEntry& entry)> FingerprintEntryCallback;
+typedef std::function<void(const AuthorizationEntry& entry)> AuthorizationEntryCallback;
+typedef std::function<void(const ProvisioningResult& result)> ProvisioningCallback;
+
+/**
+ * @brief State of a command submitted with NukiBle::submit(). The command is driven by the
+ * protocol task of the NukiBle instance, the handle can be polled or awaited from any task.
+ */
+class AsyncCommand {
+  public:
+    AsyncCommand(CmdCallback callback);
+    ~AsyncCommand();
+
+    /**
+     * @brief Returns true when the command has been completed (successfully or not)
+     */
+    bool isDone() const;
+
+    /**
+     * @brief Returns the result of the command, Nuki::CmdResult::Working while it is in progress
+     */
+    Nuki::CmdResult getResult() const;
+
+    /**
+     * @brief Blocks the calling task until the command has been completed
+     *
+     * @param timeoutMs maximum time to wait
+     * @return result of the command, Nuki::CmdResult::Working if not completed within timeoutMs
+     */
+    Nuki::CmdResult await(uint32_t timeoutMs = portMAX_DELAY);
+
+  private:
+    friend class NukiBle;
+    void complete(const Nuki::CmdResult result);
+
+    std::function<Nuki::CmdResult()> step;
+    CmdCallback callback;
+    std::atomic<Nuki::CmdResult> result;
+    EventGroupHandle_t doneEvent;
+};
+
+typedef std::shared_ptr<AsyncCommand> CmdHandle;
+
 class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
   public:
     NukiBle(const std::string& deviceName,
@@ -101,6 +196,62 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
      */
     void updateConnectionState();
 
+    /**
+     * @brief Submits an action without blocking the calling task. The action is executed by the
+     * protocol task which is woken on every received message, so one application task can drive
+     * several devices. The connection is set up by a separate connect task first, so connect retries
+     * never stall the protocol task. Only one command per device can be in progress, a command
+     * submitted while another one is running completes immediately with Nuki::CmdResult::Busy.
+     *
+     * @param action the action to execute (NukiLock::Action or NukiOpener::Action)
+     * @param callback optional, called from the protocol task when the command has been completed
+     * (from the connect task when the connection failed).
+     * Do not execute blocking BLE commands within the callback.
+     * @return handle that can be polled or awaited for the result
+     */
+    template <typename TDeviceAction>
+    CmdHandle submit(const TDeviceAction action, CmdCallback callback = nullptr);
+
+    /**
+     * @brief Set the time a blocking command (or batch) waits for a command of another task on this
+     * lock to complete. When it does not complete in time the command returns Nuki::CmdResult::Busy.
+     *
+     * @param timeoutMs timeout in milliseconds, 0 to return Busy immediately
+     */
+    void setCommandSlotTimeout(const uint32_t timeoutMs);
+
+    /**
+     * @brief Executes several actions back-to-back over one BLE connection (e.g. state, battery report
+     * and config on a status refresh) instead of setting up a connection for each of them.
+     * Blocks until all actions have been executed.
+     *
+     * @param actions the actions to execute in order (NukiLock::Action or NukiOpener::Action)
+     * @param count number of actions
+     * @param results array of count elements receiving the result of each action, actions not
+     * executed because of stopOnError get Nuki::CmdResult::Failed
+     * @param stopOnError skip the remaining actions after the first action that did not succeed
+     * @return Nuki::CmdResult::Success if all actions succeeded, else the result of the first failing action
+     */
+    template <typename TDeviceAction>
+    Nuki::CmdResult executeBatch(const TDeviceAction* actions, const uint8_t count, Nuki::CmdResult* results, const bool stopOnError = false);
+
+    /**
+     * @brief Starts disconnecting the BLE connection with the lock without waiting for the
+     * disconnect to complete. A next command waits for a pending disconnect before connecting again.
+     *
+     * @return true if a disconnect has been initiated (or was already pending)
+     */
+    bool disconnectAsync();
+
+    /**
+     * @brief Waits until a disconnect started by disconnectAsync() (or internally after an error or
+     * timeout) has been completed.
+     *
+     * @param timeoutMs maximum time to wait
+     * @return false if the pending disconnect did not complete within timeoutMs
+     */
+    bool waitForDisconnect(uint32_t timeoutMs = DISCONNECT_TIMEOUT);
+
     /**
      * @brief Set the BLE Disconnect Timeout, if longer than ~20 sec the lock will disconnect by itself
      * if there is no BLE communication
@@ -116,6 +267,189 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
      */
     void setConnectTimeout(uint8_t timeout);
 
+    /**
+     * @brief Set the BLE connection parameter profile (connection interval, latency, supervision timeout
+     * and scan window used when connecting). Takes effect on the next connect.
+     *
+     * @param profile the requested profile
+     * @param autoFallback when enabled the profile falls back to a safer profile (LowLatency -> Balanced ->
+     * PowerSave -> StackDefault) after CONN_PROFILE_FALLBACK_FAILURES consecutive failed connects, the
+     * fallback is remembered in the preferences until another profile is set
+     */
+    void setConnectionProfile(ConnectionProfile profile, bool autoFallback = true);
+
+    /**
+     * @brief Returns the connection parameter profile in use, which can be safer than the requested
+     * profile after a fallback
+     */
+    ConnectionProfile getConnectionProfile() const;
+
+    /**
+     * @brief Returns connection statistics: the profile in use, the number of successful and failed
+     * connects and the number of profile fallbacks since initialize()
+     */
+    ConnectionStats getConnectionStats() const;
+
+    /**
+     * @brief Enables automatically requesting the state when the lock advertises a status change.
+     * The request runs on the protocol task, when done EventType::KeyTurnerStatusRefreshed (and
+     * EventType::BatteryReportRefreshed) is sent to the event handler, the retrieved data can then be
+     * read with retrieveKeyTunerState() / retrieveOpenerState() and retrieveBatteryReport().
+     *
+     * @param enable true to enable auto refresh
+     * @param includeBatteryReport also request the battery report after the state
+     * @param debounceMs status changes advertised within this time after a refresh are ignored
+     */
+    void setAutoRefresh(bool enable, bool includeBatteryReport = false, uint32_t debounceMs = AUTO_REFRESH_DEBOUNCE);
+
+    /**
+     * @brief Enables caching of the config and advanced config: requestConfig() and requestAdvancedConfig()
+     * (and the config setters) are served from RAM until a received keyturner state shows a different
+     * configUpdateCount or the config is changed by this device. Changes made by others are only noticed
+     * when the keyturner state is requested (e.g. with setAutoRefresh()).
+     *
+     * @param enable true to enable the config cache
+     */
+    void setConfigCache(bool enable);
+
+    /**
+     * @brief Forces the next config and advanced config request to read from the lock
+     */
+    void invalidateConfigCache();
+
+    /**
+     * @brief Precomputes the key pair for pairing in a low priority task, so pairNuki() does not have to
+     * generate it while the lock is in pairing mode. A pair is used for one pairing attempt, a new pair
+     * is generated afterwards and an unused pair is replaced every KEY_PAIR_REFRESH_INTERVAL ms.
+     *
+     * @param enable true to start precomputing, false to stop the task and wipe the precomputed pair
+     */
+    void setKeyPairPrecompute(bool enable);
+
+    /**
+     * @brief Starts provisioning mode: every lock advertising pairing mode is queued and provisionNext()
+     * pairs the queued locks one after another. The credentials of each lock are stored under a
+     * device name derived from its BLE address ("nk" + last 3 address bytes), construct a NukiLock
+     * (or NukiOpener) with that device name to use the lock. Can only be used on a NukiBle that is not paired,
+     * key pair precomputation (setKeyPairPrecompute()) is recommended.
+     *
+     * @param callback called with the result and timing of every provisioned lock
+     * @param idType authorization id type used for pairing
+     * @return false if this NukiBle is paired
+     */
+    bool startProvisioning(ProvisioningCallback callback = nullptr, AuthorizationIdType idType = AuthorizationIdType::Bridge);
+
+    /**
+     * @brief Stops provisioning mode and clears the queue
+     */
+    void stopProvisioning();
+
+    /**
+     * @brief Pairs the next queued lock, blocks until paired or timed out. Call repeatedly (ie from loop)
+     * while provisioning, locks that stopped advertising pairing mode for PROVISION_STALE_TIMEOUT ms
+     * are dropped from the queue.
+     *
+     * @return false if no lock was waiting
+     */
+    bool provisionNext();
+
+    /**
+     * @brief Returns the number of locks waiting to be provisioned
+     */
+    uint8_t getProvisioningQueueDepth();
+
+    /**
+     * @brief Returns the provisioning counters and throughput since startProvisioning()
+     */
+    ProvisioningStats getProvisioningStats() const;
+
+    /**
+     * @brief Set the policy determining the delay between connect retries, by default a
+     * BackoffRetryPolicy is used
+     *
+     * @param retryPolicy the policy, nullptr to restore the default policy
+     */
+    void setConnectRetryPolicy(ConnectRetryPolicy* retryPolicy);
+
+    /**
+     * @brief Enables a circuit breaker that fails a connect immediately when neither an advertisement
+     * nor any other sign of life has been received from the lock within staleTimeoutMs (e.g. empty
+     * battery), instead of retrying on the shared radio. Once advertisements are received again
+     * a single connect attempt is allowed to probe the lock before the circuit is closed.
+     * Requires the BLE scanner to be running.
+     *
+     * @param enable true to enable the circuit breaker
+     * @param staleTimeoutMs time without advertisements/heartbeat after which the circuit opens
+     */
+    void setCircuitBreaker(bool enable, uint32_t staleTimeoutMs = HEARTBEAT_TIMEOUT);
+
+    /**
+     * @brief Returns the state of the connect circuit breaker
+     */
+    CircuitState getCircuitState() const;
+
+    /**
+     * @brief Replaces the source of the nonces of sent messages (by default a pool filled by the
+     * hardware RNG), e.g. a DeterministicNonceProvider for host side tests
+     *
+     * @param provider nonce provider, nullptr to restore the hardware RNG. Must outlive this object.
+     */
+    void setNonceProvider(NonceProvider* provider);
+
+    /**
+     * @brief Overrides the timeout of a command. The timeout applies to the protocol step that sends
+     * the command (Challenge for the challenge request, RequestData for reads) or, for
+     * KeypadCodeCount and KeypadCode, to waiting for that message.
+     *
+     * @param command command to set the timeout for
+     * @param timeoutMs timeout in milliseconds
+     * @param adaptive true to replace it by the adaptive timeout once enough round trips are measured,
+     * see setAdaptiveTimeouts()
+     * @return false when the maximum number of overrides (NUKI_TIMEOUT_OVERRIDES) is reached
+     */
+    bool setCommandTimeout(const Command command, const uint16_t timeoutMs, const bool adaptive = false);
+
+    /**
+     * @brief Returns the timeout of a command, see setCommandTimeout()
+     */
+    uint16_t getCommandTimeout(const Command command) const;
+
+    /**
+     * @brief Derives the timeouts of adaptive commands (challenge and reads by default) from the measured
+     * round trip times of this lock: p99 * factor clamped between floorMs and ceilingMs, so a fast link
+     * fails sooner and a slow link may wait longer than the command timeout.
+     * Takes effect after RTT_MIN_SAMPLES round trips, until then the command timeout applies.
+     *
+     * @param enable true to enable adaptive timeouts
+     * @param factor multiplied with the p99 round trip time
+     * @param floorMs minimum timeout in milliseconds
+     * @param ceilingMs maximum timeout in milliseconds
+     */
+    void setAdaptiveTimeouts(const bool enable, const float factor = ADAPTIVE_TIMEOUT_FACTOR,
+                             const uint16_t floorMs = ADAPTIVE_TIMEOUT_FLOOR,
+                             const uint16_t ceilingMs = ADAPTIVE_TIMEOUT_CEILING);
+
+    /**
+     * @brief Returns the round trip time percentiles over the last RTT_SAMPLES protocol steps
+     */
+    RoundTripStats getRoundTripStats() const;
+
+    /**
+     * @brief Returns the result of the last syncLogEntries() and the persisted log cursor
+     */
+    LogSyncStats getLogSyncStats() const;
+
+    /**
+     * @brief Resets the persisted log cursor, the next syncLogEntries() starts at the oldest entry
+     */
+    void resetLogSyncCursor();
+
+    /**
+     * @brief Returns the number of decoded payloads and the number of payloads that were shorter or
+     * longer than expected for the command (ie from a newer or older firmware)
+     */
+    PayloadStats getPayloadStats() const;
+
     /**
      * @brief Set the BLE Connect number of retries.
      *
@@ -123,6 +457,33 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
      */
     void setConnectRetries(uint8_t retries);
 
+    /**
+     * @brief Keeps the BLE connection (and the subscription on the USDIO characteristic) open between
+     * commands instead of disconnecting after the disconnect timeout.
+     * While enabled updateConnectionState() sends a keyturner state request as keep-alive when no command
+     * ran and no message was received for keepAliveIntervalMs and reconnects when the link has been lost, so
+     * updateConnectionState() needs to be run in loop or a task.
+     *
+     * @param enable true to keep the connection open
+     * @param keepAliveIntervalMs idle time after which a keep-alive is sent, should be below the ~20 sec
+     * after which the lock disconnects by itself
+     */
+    void setPersistentSession(bool enable, uint32_t keepAliveIntervalMs = KEEP_ALIVE_INTERVAL);
+
+    /**
+     * @brief Returns if the persistent session mode is enabled
+     */
+    bool isPersistentSession() const;
+
+    /**
+     * @brief Enables caching of the USDIO attribute handles in preferences, keyed by BLE address and
+     * firmware version of the lock. After a restart the cached handles are used directly to subscribe
+     * and write, skipping service discovery. Discovery is only done when the lock rejects a cached handle.
+     *
+     * @param enable true to use the cached handles
+     */
+    void setGattCache(bool enable);
+
     /**
      * @brief Returns pairing state (if credentials are stored or not)
      */
@@ -169,8 +530,11 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
      *
      * @param offset The start offset to be read.
      * @param count The number of entries to be read, starting at the specified offset.
+     * @param callback optional, called on the protocol task for every entry as it is received instead of
+     * storing the entries for getKeypadEntries(). Stays installed until the next retrieval.
      */
-    Nuki::CmdResult retrieveKeypadEntries(const uint16_t offset, const uint16_t count);
+    Nuki::CmdResult retrieveKeypadEntries(const uint16_t offset, const uint16_t count,
+                                          KeypadEntryCallback callback = nullptr);
 
     /**
      * @brief Get the Keypad Entries stored on the esp (after executing retreieveLogKeypadEntries)
@@ -179,11 +543,18 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
      */
     void getKeypadEntries(std::list<KeypadEntry>* requestedKeyPadEntries);
 
+    /**
+     * @brief Returns the Keypad Entries stored on the esp without copying them, valid until the next retrieval
+     */
+    const EntryBuffer<KeypadEntry, NUKI_KEYPAD_ENTRY_CAPACITY>& getKeypadEntries() const;
+
     /**
      * @brief Request the lock via BLE to send the existing fingerprint entries
      *
+     * @param callback optional, called on the protocol task for every entry as it is received instead of
+     * storing the entries for getFingerprintEntries(). Stays installed until the next retrieval.
      */
-    Nuki::CmdResult retrieveFingerprintEntries();
+    Nuki::CmdResult retrieveFingerprintEntries(FingerprintEntryCallback callback = nullptr);
     
     /**
      * @brief Get the Fingerprint Entries stored on the esp (after executing retrieveFingerprintEntries)
@@ -192,6 +563,11 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
      */
     void getFingerprintEntries(std::list<FingerprintEntry>* requestedFingerprintEntries);    
 
+    /**
+     * @brief Returns the Fingerprint Entries stored on the esp without copying them, valid until the next retrieval
+     */
+    const EntryBuffer<FingerprintEntry>& getFingerprintEntries() const;
+
     /**
     * @brief Delete a Keypad Entry
     *
@@ -204,8 +580,11 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
      *
      * @param offset The start offset to be read.
      * @param count The number of entries to be read, starting at the specified offset.
+     * @param callback optional, called on the protocol task for every entry as it is received instead of
+     * storing the entries for getAuthorizationEntries(). Stays installed until the next retrieval.
      */
-    Nuki::CmdResult retrieveAuthorizationEntries(const uint16_t offset, const uint16_t count);
+    Nuki::CmdResult retrieveAuthorizationEntries(const uint16_t offset, const uint16_t count,
+                                                 AuthorizationEntryCallback callback = nullptr);
 
     /**
      * @brief Get the Authorization Entries stored on the esp (after executing retreiveAuthorizationEntries)
@@ -214,6 +593,11 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
      */
     void getAuthorizationEntries(std::list<AuthorizationEntry>* requestedAuthorizationEntries);
 
+    /**
+     * @brief Returns the Authorization Entries stored on the esp without copying them, valid until the next retrieval
+     */
+    const EntryBuffer<AuthorizationEntry, NUKI_AUTHORIZATION_ENTRY_CAPACITY>& getAuthorizationEntries() const;
+
     /**
      * @brief Sends a new authorization entry to the lock via BLE
      *
@@ -377,6 +761,36 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
     int64_t getLastHeartbeat();
     #endif
 
+    /**
+    * @brief Returns the number of received indications waiting to be processed by the protocol worker task.
+    *
+    * @return Number of queued frames
+    */
+    uint32_t getRxQueueDepth() const;
+
+    /**
+    * @brief Returns the highest number of queued indications seen since initialize().
+    *
+    * @return Maximum queue depth
+    */
+    uint32_t getRxQueueMaxDepth() const;
+
+    /**
+    * @brief Returns the number of received indications dropped because the RX queue was full
+    * or the indication did not fit in a queue slot.
+    *
+    * @return Number of dropped frames
+    */
+    uint32_t getRxDroppedFrames() const;
+
+    /**
+    * @brief Returns the number of received entries (log, keypad, ...) dropped because the entry buffer
+    * of the list was full, see NukiEntryBuffer.h
+    *
+    * @return Number of dropped entries
+    */
+    uint32_t getDroppedEntries() const;
+
      /**
      * @brief Whether to enable or disable connect debug logging
      *
@@ -430,23 +844,59 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
     Nuki::CmdResult executeAction(const TDeviceAction action);
 
     template <typename TDeviceAction>
-    Nuki::CmdResult cmdStateMachine(const TDeviceAction action);
+    Nuki::CmdResult runAction(const TDeviceAction& action);
 
     template <typename TDeviceAction>
-    Nuki::CmdResult cmdChallStateMachine(const TDeviceAction action, const bool sendPinCode = false);
+    Nuki::CmdResult stepAction(const TDeviceAction& action);
 
-    template <typename TDeviceAction>
-    Nuki::CmdResult cmdChallAccStateMachine(const TDeviceAction action);
+    /**
+     * @brief Executes the next step of the protocol descriptor of the given command type, shared
+     * by all device actions
+     *
+     * @param cmdType command type, selects the descriptor
+     * @param command command sent with the action payload
+     * @param payload action payload
+     * @param payloadLen length of the action payload
+     * @return Working as long as the command is not finished
+     */
+    Nuki::CmdResult stepProtocol(const Nuki::CommandType cmdType, const Command command,
+                                 const unsigned char* payload, const uint8_t payloadLen);
 
     virtual void handleReturnMessage(Command returnCode, unsigned char* data, uint16_t dataLen);
+
+    /**
+     * @brief Decodes a received payload into its data type, bounds checked against the size of the type
+     * and the expected size of the command (see NukiPayloadDecoder.h)
+     */
+    template <typename T>
+    void decodeReturnPayload(const Command returnCode, T* target, const unsigned char* data, const uint16_t dataLen);
+    virtual const PayloadSize* findExpectedPayloadSize(const Command returnCode) const;
+    virtual CmdHandle requestStateAsync(CmdCallback callback) = 0;
+    virtual CmdHandle requestBatteryReportAsync(CmdCallback callback) = 0;
+
+    /**
+     * @brief Synchronizes the log entries newer than the persisted cursor in pages of pageSize entries,
+     * the entries are delivered by the device specific requestLogPage() through acceptLogEntry()
+     */
+    Nuki::CmdResult syncLog(const uint16_t pageSize);
+    virtual Nuki::CmdResult requestLogPage(const uint32_t startIndex, const uint16_t count, const uint8_t sortOrder) = 0;
+    bool acceptLogEntry(const uint32_t index);
     virtual void logErrorCode(uint8_t errorCode) = 0;
+    void entryDropped();
+    void updateGattCacheFirmwareVersion(const unsigned char* firmwareVersion);
+    void checkConfigUpdateCount(const uint8_t configUpdateCount);
 
     // Cannot initialize to any meaningful value since error namespaces are only
     // defined for NukeBle descendants. Using zero as a safe default, which should
     // work better than random for a general case.
-    uint8_t errorCode = 0;
+    std::atomic<uint8_t> errorCode{0};
+
+    //written by the protocol task after a message has been handled
+    std::atomic<Command> lastMsgCodeReceived{Command::Empty};
 
-    Command lastMsgCodeReceived = Command::Empty;
+    bool configCacheEnabled = false;
+    bool configCacheValid = false;
+    bool advancedConfigCacheValid = false;
 
     bool debugNukiConnect = false;
     bool debugNukiCommunication = false;
@@ -458,17 +908,29 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
 
   private:
     bool connecting = false;
-    bool disconnecting = false;
+    std::atomic_bool disconnecting;
     bool statusUpdated = false;
     bool refreshServices = false;
     bool smartLockUltra = false;
     bool ultraAuthInfoCommandReceived = false;
     bool encryptPairing = false;
     bool recieveEncrypted = false;
+    bool persistentSession = false;
+    bool usdioRegistered = false;
+    std::atomic_bool commandInProgress;
+    std::atomic_bool keepAliveRunning{false};
+    uint32_t keepAliveInterval = KEEP_ALIVE_INTERVAL;
     uint16_t timeoutDuration = 1000;
     uint8_t connectTimeoutSec = 1;
     uint8_t connectRetries = 5;
-    uint32_t countDisconnects = 0;
+    EventGroupHandle_t connectionEvents = nullptr;
+    //code of each message handled by the protocol task, for a blocking command waiting for the lock
+    QueueHandle_t responseQueue = nullptr;
+    #ifndef NUKI_64BIT_TIME
+    uint32_t disconnectStart = 0;
+    #else
+    int64_t disconnectStart = 0;
+    #endif
 
     void onConnect(BLEClient*) override;
     #ifdef NUKI_USE_LATEST_NIMBLE
@@ -477,6 +939,7 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
     void onDisconnect(BLEClient*) override;
     #endif
     void disconnect();
+    void keepSessionAlive();
     #ifndef NUKI_USE_LATEST_NIMBLE
     void onResult(BLEAdvertisedDevice* advertisedDevice) override;
     #else
@@ -484,9 +947,19 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
     #endif
     bool registerOnGdioChar();
     bool registerOnUsdioChar();
+    bool registerOnCachedUsdioHandle();
+    bool writeCachedHandle(uint16_t handle, const uint8_t* data, uint16_t length);
+    void loadGattCache();
+    void saveGattCache();
+    void deleteGattCache();
+    static int onCachedHandleWritten(uint16_t connHandle, const ble_gatt_error* error, ble_gatt_attr* attr, void* arg);
+    static int onGapEvent(ble_gap_event* event, void* arg);
+    uint16_t getConnHandle();
 
     bool sendPlainMessage(Command commandIdentifier, const unsigned char* payload, const uint8_t payloadLen);
     bool sendEncryptedMessage(Command commandIdentifier, const unsigned char* payload, const uint8_t payloadLen);
+    uint16_t buildPlainFrame(Command commandIdentifier, const unsigned char* payload, const uint8_t payloadLen);
+    int buildEncryptedFrame(Command commandIdentifier, const unsigned char* payload, const uint8_t payloadLen);
 
     #ifdef NUKI_USE_LATEST_NIMBLE
     NimBLERemoteCharacteristic::notify_callback callback;
@@ -495,7 +968,159 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
     #endif
 
     void notifyCallback(BLERemoteCharacteristic* pBLERemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify);
+    Command handleIndication(const NimBLEUUID& charUUID, uint8_t* recData, size_t length);
+    Command waitForResponse(const uint32_t timeoutMs);
+    uint32_t getStepTimeLeft() const;
+
+    enum class RxChannel : uint8_t {
+      Gdio,
+      GdioUltra,
+      Usdio
+    };
+
+    struct RxFrame {
+      RxChannel channel;
+      uint16_t length;
+      uint8_t data[NUKI_RX_FRAME_SIZE];
+    };
+
+    //single producer (NimBLE host task) / single consumer (protocol worker task) ring buffer
+    RxQueue<RxFrame, NUKI_RX_QUEUE_SIZE> rxQueue;
+    std::atomic<uint32_t> droppedEntries{0};
+    TaskHandle_t rxTaskHandle = nullptr;
+    TaskHandle_t connectTaskHandle = nullptr;
+
+    RxFrame* reserveRxFrame(size_t length);
+    void commitRxFrame();
+    void takeNonce(uint8_t* nonce, const size_t len);
+    static void rxTask(void* pvParameters);
+    static void connectTask(void* pvParameters);
+    void processRxQueue();
+
+    struct ProvisioningCandidate {
+      BLEAddress address;
+      bool ultra;
+      #ifndef NUKI_64BIT_TIME
+      unsigned long firstSeen;
+      unsigned long lastSeen;
+      #else
+      int64_t firstSeen;
+      int64_t lastSeen;
+      #endif
+    };
+
+    void queueProvisioningCandidate(const BLEAddress& address, const bool ultra);
+    bool takeProvisioningCandidate(ProvisioningCandidate* candidate);
+    PairingState runPairing();
+    bool provisioning = false;
+    ProvisioningCallback provisioningCallback = nullptr;
+    SemaphoreHandle_t provisioningMutex = nullptr;
+    ProvisioningCandidate provisioningQueue[NUKI_PROVISION_QUEUE_SIZE];
+    uint8_t provisioningQueueCount = 0;
+    BLEAddress provisionedAddresses[NUKI_PROVISION_QUEUE_SIZE];
+    uint8_t provisionedAddressIndex = 0;
+    ProvisioningStats provisioningStats = {};
+    #ifndef NUKI_64BIT_TIME
+    unsigned long provisioningStart = 0;
+    #else
+    int64_t provisioningStart = 0;
+    #endif
+
+    static void keyPairTask(void* pvParameters);
+    bool takePrecomputedKeyPair();
+    TaskHandle_t keyPairTaskHandle = nullptr;
+    SemaphoreHandle_t keyPairMutex = nullptr;
+    bool precomputedKeyPairReady = false;
+    unsigned char precomputedPublicKey[32] = {};
+    unsigned char precomputedPrivateKey[32] = {};
+
+    friend class NukiDeviceManager;
+    NukiDeviceManager* deviceManager = nullptr;
+    void triggerAutoRefresh();
+    bool autoRefresh = false;
+    bool autoRefreshBattery = false;
+    uint32_t autoRefreshDebounce = AUTO_REFRESH_DEBOUNCE;
+    std::atomic_bool autoRefreshPending;
+    #ifndef NUKI_64BIT_TIME
+    unsigned long lastAutoRefresh = 0;
+    #else
+    int64_t lastAutoRefresh = 0;
+    #endif
+
+    bool connectAllowed();
+    void waitBeforeRetry(uint8_t retry);
+    BackoffRetryPolicy defaultRetryPolicy;
+    ConnectRetryPolicy* retryPolicy = &defaultRetryPolicy;
+    ConnectCircuitBreaker circuitBreaker;
+    const CommandTimeout* findCommandTimeout(const Command command) const;
+    uint32_t getStepTimeout(const Command command) const;
+    CommandTimeout timeoutOverrides[NUKI_TIMEOUT_OVERRIDES];
+    uint8_t timeoutOverrideCount = 0;
+    uint32_t stepTimeout = CMD_TIMEOUT;
+    bool adaptiveTimeoutsEnabled = false;
+    float adaptiveTimeoutFactor = ADAPTIVE_TIMEOUT_FACTOR;
+    uint16_t adaptiveTimeoutFloor = ADAPTIVE_TIMEOUT_FLOOR;
+    uint16_t adaptiveTimeoutCeiling = ADAPTIVE_TIMEOUT_CEILING;
+    RoundTripWindow<RTT_SAMPLES> roundTrips;
+
+    //results of the log page being received, collected by the protocol task under logSyncMutex and
+    //merged into logSyncStats by the task executing syncLog() when the page is done
+    struct LogSyncPage {
+      bool open;
+      bool probing;
+      uint32_t cursor;
+      uint32_t entries;
+      uint32_t missingEntries;
+      uint32_t newestIndex;
+    };
+
+    Nuki::CmdResult waitForLogPage(const uint16_t count);
+    void openLogPage(const uint32_t cursor, const bool probing);
+    LogSyncPage closeLogPage();
+    void saveLogSyncCursor();
+    LogSyncStats logSyncStats = {};
+    PayloadStats payloadStats = {};
+    bool logSyncCursorLoaded = false;
+    LogSyncPage logSyncPage = {};
+    SemaphoreHandle_t logSyncMutex = nullptr;
+    std::atomic<uint16_t> logSyncReceived{0};
+    std::atomic_bool logSyncComplete{false};
+    #ifndef NUKI_64BIT_TIME
+    unsigned long lastLinkActivity = 0;
+    #else
+    int64_t lastLinkActivity = 0;
+    #endif
+
+    void setupClient();
+    void applyConnectionProfile();
+    void fallbackConnectionProfile();
+    #if defined(CONFIG_IDF_TARGET_ESP32C5)
+    ConnectionProfile requestedProfile = ConnectionProfile::StackDefault;
+    #else
+    ConnectionProfile requestedProfile = ConnectionProfile::Balanced;
+    #endif
+    ConnectionProfile connectionProfile = requestedProfile;
+    bool profileAutoFallback = true;
+    bool connectionParamsApplied = false;
+    bool preferencesOpen = false;
+    uint8_t profileConnectFailures = 0;
+    ConnectionStats connectionStats = {};
+    void attachClient(BLEClient* client, bool refreshAttributes);
+    bool claimIdleClient(bool disconnectIdle);
+    bool reclaimClient();
+    void releaseClient();
+    void enableScanning(bool enable);
+
+    bool checkPaired();
+    bool claimCommandSlot(const uint32_t timeoutMs);
+    void releaseCommandSlot();
+    uint32_t commandSlotTimeout = COMMAND_SLOT_TIMEOUT;
+    Nuki::CmdResult startAsyncCommand(CmdHandle command);
+    void stepAsyncCommand();
+    CmdHandle asyncCommand;
+    std::atomic_bool asyncCommandPending;
     void saveCredentials();
+    void saveCredentials(Preferences& store);
     bool retrieveCredentials();
     void deleteCredentials();
     Nuki::PairingState pairStateMachine(const Nuki::PairingState nukiPairingState);
@@ -530,15 +1155,26 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
     BLERemoteService* pKeyturnerDataService = nullptr;
     BLERemoteCharacteristic* pUsdioCharacteristic = nullptr;
 
-    Nuki::CommandState nukiCommandState = Nuki::CommandState::Idle;
+    GattHandleCache gattCache;
+    unsigned char lockFirmwareVersion[3] = {0};
+    bool gattCacheEnabled = false;
+    bool gattCacheValid = false;
+    bool gattDiscovered = false;
+    std::atomic_bool usdioCachedActive;
+    std::atomic_int cachedWriteStatus;
+    ble_gap_event_listener gapEventListener;
+    bool gapEventListenerRegistered = false;
+
+    uint8_t protocolStepIndex = 0;
 
     BleScanner::Publisher* bleScanner = nullptr;
     bool isPaired = false;
 
-    Nuki::SmartlockEventHandler* eventHandler;
+    Nuki::SmartlockEventHandler* eventHandler = nullptr;
 
-    uint8_t receivedStatus;
-    bool crcCheckOke;
+    //written by the protocol task before lastMsgCodeReceived, read by the task of a blocking command
+    std::atomic<uint8_t> receivedStatus{0};
+    std::atomic_bool crcCheckOke{false};
 
     unsigned char remotePublicKey[32] = {0x00};
     unsigned char challengeNonceK[32] = {0x00};
@@ -549,11 +1185,15 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
     uint32_t ultraPinCode = 000000;
     unsigned char secretKeyK[32] = {0x00};
 
-    unsigned char sentNonce[crypto_secretbox_NONCEBYTES] = {};
+    //frame of the message being sent, built and encrypted in place
+    uint8_t txFrame[NUKI_TX_FRAME_SIZE] = {};
+    HardwareNonceProvider hardwareNonceProvider;
+    NonceProvider* nonceProvider = &hardwareNonceProvider;
 
     uint16_t nrOfKeypadCodes = 0;
-    uint8_t nrOfReceivedKeypadCodes = 0;
-    bool keypadCodeCountReceived = false;
+    std::atomic<uint8_t> nrOfReceivedKeypadCodes{0};
+    std::atomic_bool keypadCodeCountReceived{false};
+    int16_t cachedConfigUpdateCount = -1;
     uint16_t logEntryCount = 0;
     bool loggingEnabled = false;
     std::atomic_int rssi;
@@ -562,18 +1202,23 @@ class NukiBle : public BLEClientCallbacks, public BleScanner::Subscriber {
     std::atomic_ulong lastHeartbeat;
     unsigned long lastStartTimeout = 0;
     unsigned long pairingLastSeen = 0;
+    unsigned long lastReconnectAttempt = 0;
     std::atomic_ulong lastReceivedBeaconTs;
     #else
     int64_t timeNow = 0;
     std::atomic_llong lastHeartbeat;
     int64_t lastStartTimeout = 0;
     int64_t pairingLastSeen = 0;
+    int64_t lastReconnectAttempt = 0;
     std::atomic_llong lastReceivedBeaconTs;
     #endif
 
-    std::list<KeypadEntry> listOfKeyPadEntries;
-    std::list<FingerprintEntry> listOfFingerprintEntries;
-    std::list<AuthorizationEntry> listOfAuthorizationEntries;
+    EntryBuffer<KeypadEntry, NUKI_KEYPAD_ENTRY_CAPACITY> listOfKeyPadEntries;
+    EntryBuffer<FingerprintEntry> listOfFingerprintEntries;
+    EntryBuffer<AuthorizationEntry, NUKI_AUTHORIZATION_ENTRY_CAPACITY> listOfAuthorizationEntries;
+    KeypadEntryCallback keypadEntryCallback = nullptr;
+    FingerprintEntryCallback fingerprintEntryCallback = nullptr;
+    AuthorizationEntryCallback authorizationEntryCallback = nullptr;
     AuthorizationIdType authorizationIdType = AuthorizationIdType::Bridge;
 };
 
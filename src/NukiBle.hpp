@@ -4,428 +4,126 @@
 namespace Nuki {
 template<typename TDeviceAction>
 Nuki::CmdResult NukiBle::executeAction(const TDeviceAction action) {
-  if(!isPairedWithLock()) {
-    if (debugNukiConnect) {
-      logMessage("************************ CHECK PAIRED ************************");
+  if (!checkPaired()) {
+    return Nuki::CmdResult::NotPaired;
+  }
+
+  if (!claimCommandSlot(commandSlotTimeout)) {
+    if (debugNukiCommunication) {
+      logMessage("Another command is in progress");
+    }
+    return Nuki::CmdResult::Busy;
+  }
+
+  Nuki::CmdResult result = runAction(action);
+  releaseCommandSlot();
+  return result;
+}
+
+template<typename TDeviceAction>
+Nuki::CmdResult NukiBle::executeBatch(const TDeviceAction* actions, const uint8_t count, Nuki::CmdResult* results, const bool stopOnError) {
+  for (uint8_t i = 0; i < count; i++) {
+    results[i] = Nuki::CmdResult::Failed;
+  }
+
+  if (!checkPaired()) {
+    for (uint8_t i = 0; i < count; i++) {
+      results[i] = Nuki::CmdResult::NotPaired;
+    }
+    return Nuki::CmdResult::NotPaired;
+  }
+
+  if (!claimCommandSlot(commandSlotTimeout)) {
+    if (debugNukiCommunication) {
+      logMessage("Another command is in progress");
+    }
+    for (uint8_t i = 0; i < count; i++) {
+      results[i] = Nuki::CmdResult::Busy;
     }
-    if (retrieveCredentials()) {
-      if (debugNukiConnect) {
-        logMessage("Credentials retrieved from preferences, ready for commands");
+    return Nuki::CmdResult::Busy;
+  }
+
+  if (debugNukiCommunication) {
+    logMessageVar("Start executing batch of %d commands", (unsigned int)count);
+  }
+
+  //the connection (and subscription) set up by the first command is reused by the next ones
+  Nuki::CmdResult batchResult = Nuki::CmdResult::Success;
+  for (uint8_t i = 0; i < count; i++) {
+    results[i] = runAction(actions[i]);
+
+    if (results[i] != Nuki::CmdResult::Success) {
+      if (batchResult == Nuki::CmdResult::Success) {
+        batchResult = results[i];
       }
-    } else {
-      if (debugNukiConnect) {
-        logMessage("Credentials NOT retrieved from preferences, first pair with the lock");
+      if (stopOnError) {
+        break;
       }
-      return Nuki::CmdResult::NotPaired;
     }
   }
 
+  releaseCommandSlot();
+  return batchResult;
+}
+
+template<typename TDeviceAction>
+Nuki::CmdResult NukiBle::runAction(const TDeviceAction& action) {
   if (debugNukiCommunication) {
     logMessageVar("Start executing: %02x ", (unsigned int)action.command);
   }
 
   while (1) {
-    extendDisconnectTimeout();
-      
-    Nuki::CmdResult result;
-    if (action.cmdType == Nuki::CommandType::Command) {
-      result = cmdStateMachine(action);
-    }
-    else if (action.cmdType == Nuki::CommandType::CommandWithChallenge) {
-      result = cmdChallStateMachine(action);
-    }
-    else if (action.cmdType == Nuki::CommandType::CommandWithChallengeAndAccept) {
-      result = cmdChallAccStateMachine(action);
-    }
-    else if (action.cmdType == Nuki::CommandType::CommandWithChallengeAndPin) {
-      result = cmdChallStateMachine(action, true);
-    }
-    else {
-      logMessage("Unknown cmd type", 2);        
-      disconnect();
-      return Nuki::CmdResult::Failed;
-    }
+    uint8_t previousStep = protocolStepIndex;
+    Nuki::CmdResult result = stepAction(action);
     if (result != Nuki::CmdResult::Working) {
-      if (result == Nuki::CmdResult::Error || result == Nuki::CmdResult::Failed) {
-        disconnect();
-      }
       return result;
     }
     #ifndef NUKI_NO_WDT_RESET
     esp_task_wdt_reset();
     #endif
-    delay(10);
+    if (protocolStepIndex == previousStep) {
+      //waiting for the lock, woken with the code of each message the protocol task handled or when the step times out
+      waitForResponse(getStepTimeLeft());
+    }
   }
   return Nuki::CmdResult::Failed;
 }
 
-template <typename TDeviceAction>
-Nuki::CmdResult NukiBle::cmdStateMachine(const TDeviceAction action) {
-  extendDisconnectTimeout();  
-  switch (nukiCommandState) {
-    case CommandState::Idle: {
-      if (debugNukiCommunication) {
-        logMessageVar("************************ SENDING COMMAND [%d] ************************", (unsigned int)action.command);
-      }
-      lastMsgCodeReceived = Command::Empty;
+template<typename TDeviceAction>
+CmdHandle NukiBle::submit(const TDeviceAction action, CmdCallback callback) {
+  CmdHandle command = std::make_shared<AsyncCommand>(callback);
 
-      if (sendEncryptedMessage(Command::RequestData, action.payload, action.payloadLen)) {
-        #ifndef NUKI_64BIT_TIME
-        timeNow = millis();
-        #else
-        timeNow = (esp_timer_get_time() / 1000);
-        #endif
-        nukiCommandState = CommandState::CmdSent;
-      } else {
-        if (debugNukiCommunication) {
-          logMessage("************************ SENDING COMMAND FAILED ************************");
-        }
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Failed;
-      }
-      break;
-    }
-    case CommandState::CmdSent: {
-      #ifndef NUKI_64BIT_TIME
-      if (millis() - timeNow > CMD_TIMEOUT) {
-      #else
-      if ((esp_timer_get_time() / 1000) - timeNow > CMD_TIMEOUT) {
-      #endif
-        logMessage("************************ COMMAND FAILED TIMEOUT************************", 2);
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        return Nuki::CmdResult::TimeOut;
-      } else if (lastMsgCodeReceived != Command::ErrorReport && lastMsgCodeReceived != Command::Empty) {
-        if (debugNukiCommunication) {
-          logMessage("************************ COMMAND DONE ************************");
-        }
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Success;
-      } else if (lastMsgCodeReceived == Command::ErrorReport && errorCode != 69) {
-        if (debugNukiCommunication) {
-          logMessage("************************ COMMAND FAILED ************************");
-        }
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Failed;
-      } else if (lastMsgCodeReceived == Command::ErrorReport && errorCode == 69) {
-        if (debugNukiCommunication) {
-          logMessage("************************ COMMAND FAILED LOCK BUSY ************************");
-        }
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Lock_Busy;
-      }
-    }
-    break;
-    default: {
-      logMessage("Unknown request command state", 2);
-      disconnect();
-      return Nuki::CmdResult::Failed;
-      break;
-    }
+  if (!checkPaired()) {
+    command->complete(Nuki::CmdResult::NotPaired);
+    return command;
   }
-  return Nuki::CmdResult::Working;
-}
 
-template <typename TDeviceAction>
-Nuki::CmdResult NukiBle::cmdChallStateMachine(const TDeviceAction action, const bool sendPinCode) {
-  extendDisconnectTimeout();
-  switch (nukiCommandState) {
-    case CommandState::Idle: {
-      if (debugNukiCommunication) {
-        logMessage("************************ SENDING CHALLENGE ************************");
-      }
-      lastMsgCodeReceived = Command::Empty;
-      unsigned char payload[sizeof(Command)] = {0x04, 0x00};  //challenge
+  if (debugNukiCommunication) {
+    logMessageVar("Submitting: %02x ", (unsigned int)action.command);
+  }
 
-      if (sendEncryptedMessage(Command::RequestData, payload, sizeof(Command))) {
-        #ifndef NUKI_64BIT_TIME
-        timeNow = millis();
-        #else
-        timeNow = (esp_timer_get_time() / 1000);
-        #endif
-        nukiCommandState = CommandState::ChallengeSent;
-      } else {
-        if (debugNukiCommunication) {
-          logMessage("************************ SENDING CHALLENGE FAILED ************************");
-        }
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Failed;
-      }
-      break;
-    }
-    case CommandState::ChallengeSent: {
-      if (debugNukiCommunication) {
-        logMessage("************************ RECEIVING CHALLENGE RESPONSE************************");
-      }
-      #ifndef NUKI_64BIT_TIME
-      if (millis() - timeNow > CMD_TIMEOUT) {
-      #else
-      if ((esp_timer_get_time() / 1000) - timeNow > CMD_TIMEOUT) {
-      #endif
-        logMessage("************************ COMMAND FAILED TIMEOUT ************************", 2);
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        return Nuki::CmdResult::TimeOut;
-      } else if (lastMsgCodeReceived == Command::Challenge) {
-        nukiCommandState = CommandState::ChallengeRespReceived;
-        lastMsgCodeReceived = Command::Empty;
-      }
-      break;
-    }
-    case CommandState::ChallengeRespReceived: {
-      if (debugNukiCommunication) {
-        logMessageVar("************************ SENDING COMMAND [%d] ************************", (unsigned int)action.command);
-      }
-      lastMsgCodeReceived = Command::Empty;
-      crcCheckOke = false;
-      //add received challenge nonce to payload
-      uint8_t payloadLen = action.payloadLen + sizeof(challengeNonceK);
-      if (sendPinCode) {
-        if (isLockUltra()) {
-          payloadLen = payloadLen + 4;  
-        } else {
-          payloadLen = payloadLen + 2;
-        }
-      }
-      unsigned char payload[payloadLen];
-      memcpy(payload, action.payload, action.payloadLen);
-      memcpy(&payload[action.payloadLen], challengeNonceK, sizeof(challengeNonceK));
-      if (sendPinCode) {
-        if (isLockUltra()) {
-          memcpy(&payload[action.payloadLen + sizeof(challengeNonceK)], &ultraPinCode, 4);
-        } else {
-          memcpy(&payload[action.payloadLen + sizeof(challengeNonceK)], &pinCode, 2);
-        }        
-      }
+  command->step = [this, action]() {
+    return stepAction(action);
+  };
 
-      if (sendEncryptedMessage(action.command, payload, payloadLen)) {
-        #ifndef NUKI_64BIT_TIME
-        timeNow = millis();
-        #else
-        timeNow = (esp_timer_get_time() / 1000);
-        #endif
-        nukiCommandState = CommandState::CmdSent;
-      } else {
-        if (debugNukiCommunication) {
-          logMessage("************************ SENDING COMMAND FAILED ************************");
-        }
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Failed;
-      }
-      break;
-    }
-    case CommandState::CmdSent: {
-      if (debugNukiCommunication) {
-        logMessage("************************ RECEIVING DATA ************************");
-      }
-      #ifndef NUKI_64BIT_TIME
-      if (millis() - timeNow > CMD_TIMEOUT) {
-      #else
-      if ((esp_timer_get_time() / 1000) - timeNow > CMD_TIMEOUT) {
-      #endif
-        logMessage("************************ COMMAND FAILED TIMEOUT ************************", 2);
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        return Nuki::CmdResult::TimeOut;
-      } else if (lastMsgCodeReceived == Command::ErrorReport && errorCode != 69) {
-        if (debugNukiCommunication) {
-          logMessage("************************ COMMAND FAILED ************************");
-        }
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Failed;
-      } else if (lastMsgCodeReceived == Command::ErrorReport && errorCode == 69) {
-        if (debugNukiCommunication) {
-          logMessage("************************ COMMAND FAILED LOCK BUSY ************************");
-        }
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Lock_Busy;
-      } else if (crcCheckOke) {
-        if (debugNukiCommunication) {
-          logMessage("************************ DATA RECEIVED ************************");
-        }
-        nukiCommandState = CommandState::Idle;
-        return Nuki::CmdResult::Success;
-      }
-      break;
-    }
-    default:
-      logMessage("Unknown request command state", 2);
-      disconnect();
-      return Nuki::CmdResult::Failed;
-      break;
+  Nuki::CmdResult result = startAsyncCommand(command);
+  if (result != Nuki::CmdResult::Working) {
+    command->complete(result);
   }
-  return Nuki::CmdResult::Working;
+  return command;
 }
 
-template <typename TDeviceAction>
-Nuki::CmdResult NukiBle::cmdChallAccStateMachine(const TDeviceAction action) {
-  extendDisconnectTimeout();
-  switch (nukiCommandState) {
-    case CommandState::Idle: {
-      if (debugNukiCommunication) {
-        logMessage("************************ SENDING CHALLENGE ************************");
-      }
-      lastMsgCodeReceived = Command::Empty;
-      unsigned char payload[sizeof(Command)] = {0x04, 0x00};  //challenge
-
-      if (sendEncryptedMessage(Command::RequestData, payload, sizeof(Command))) {
-        #ifndef NUKI_64BIT_TIME
-        timeNow = millis();
-        #else
-        timeNow = (esp_timer_get_time() / 1000);
-        #endif
-        nukiCommandState = CommandState::ChallengeSent;
-      } else {
-        if (debugNukiCommunication) {
-          logMessage("************************ SENDING CHALLENGE FAILED ************************");
-        }
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Failed;
-      }
-      break;
-    }
-    case CommandState::ChallengeSent: {
-      if (debugNukiCommunication) {
-        logMessage("************************ RECEIVING CHALLENGE RESPONSE************************");
-      }
-      #ifndef NUKI_64BIT_TIME
-      if (millis() - timeNow > CMD_TIMEOUT) {
-      #else
-      if ((esp_timer_get_time() / 1000) - timeNow > CMD_TIMEOUT) {
-      #endif
-        logMessage("************************ COMMAND FAILED TIMEOUT ************************", 2);
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        return Nuki::CmdResult::TimeOut;
-      } else if (lastMsgCodeReceived == Command::Challenge) {
-        nukiCommandState = CommandState::ChallengeRespReceived;
-        lastMsgCodeReceived = Command::Empty;
-      }
-      break;
-    }
-    case CommandState::ChallengeRespReceived: {
-      if (debugNukiCommunication) {
-        logMessageVar("************************ SENDING COMMAND [%d] ************************", (unsigned int)action.command);
-      }
-      lastMsgCodeReceived = Command::Empty;
-      //add received challenge nonce to payload
-      uint8_t payloadLen = action.payloadLen + sizeof(challengeNonceK);
-      unsigned char payload[payloadLen];
-      memcpy(payload, action.payload, action.payloadLen);
-      memcpy(&payload[action.payloadLen], challengeNonceK, sizeof(challengeNonceK));
+template<typename TDeviceAction>
+Nuki::CmdResult NukiBle::stepAction(const TDeviceAction& action) {
+  return stepProtocol(action.cmdType, action.command, action.payload, action.payloadLen);
+}
 
-      if (sendEncryptedMessage(action.command, payload, action.payloadLen + sizeof(challengeNonceK))) {
-        #ifndef NUKI_64BIT_TIME
-        timeNow = millis();
-        #else
-        timeNow = (esp_timer_get_time() / 1000);
-        #endif
-        nukiCommandState = CommandState::CmdSent;
-      } else {
-        if (debugNukiCommunication) {
-          logMessage("************************ SENDING COMMAND FAILED ************************");
-        }
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Failed;
-      }
-      break;
-    }
-    case CommandState::CmdSent: {
-      if (debugNukiCommunication) {
-        logMessage("************************ RECEIVING ACCEPT ************************");
-      }
-      #ifndef NUKI_64BIT_TIME
-      if (millis() - timeNow > CMD_TIMEOUT) {
-      #else
-      if ((esp_timer_get_time() / 1000) - timeNow > CMD_TIMEOUT) {
-      #endif
-        logMessage("************************ ACCEPT FAILED TIMEOUT ************************", 2);
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        return Nuki::CmdResult::TimeOut;
-      } else if (lastMsgCodeReceived == Command::Status && (CommandStatus)receivedStatus == CommandStatus::Accepted) {
-        #ifndef NUKI_64BIT_TIME
-        timeNow = millis();
-        #else
-        timeNow = (esp_timer_get_time() / 1000);
-        #endif
-        nukiCommandState = CommandState::CmdAccepted;
-        lastMsgCodeReceived = Command::Empty;
-      } else if (lastMsgCodeReceived == Command::Status && (CommandStatus)receivedStatus == CommandStatus::Complete) {
-        //accept was skipped on lock because ie unlock command when lock allready unlocked?
-        if (debugNukiCommunication) {
-          logMessage("************************ COMMAND SUCCESS (SKIPPED) ************************");
-        }
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Success;
-      }
-      break;
+template <typename T>
+void NukiBle::decodeReturnPayload(const Command returnCode, T* target, const unsigned char* data, const uint16_t dataLen) {
+  if (!decodePayload(target, data, dataLen, (uint16_t)returnCode, findExpectedPayloadSize(returnCode), &payloadStats)) {
+    if (debugNukiCommunication) {
+      logMessageVar("Unexpected payload length %d", dataLen, 2);
     }
-    case CommandState::CmdAccepted: {
-      if (debugNukiCommunication) {
-        logMessage("************************ RECEIVING COMPLETE ************************");
-      }
-      #ifndef NUKI_64BIT_TIME
-      if (millis() - timeNow > CMD_TIMEOUT) {
-      #else
-      if ((esp_timer_get_time() / 1000) - timeNow > CMD_TIMEOUT) {
-      #endif
-        logMessage("************************ COMMAND FAILED TIMEOUT ************************", 2);
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        return Nuki::CmdResult::TimeOut;
-      } else if (lastMsgCodeReceived == Command::ErrorReport && errorCode != 69) {
-        if (debugNukiCommunication) {
-          logMessage("************************ COMMAND FAILED ************************");
-        }
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Failed;
-      } else if (lastMsgCodeReceived == Command::ErrorReport && errorCode == 69) {
-        if (debugNukiCommunication) {
-          logMessage("************************ COMMAND FAILED LOCK BUSY ************************");
-        }
-        disconnect();
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Lock_Busy;
-      } else if ((CommandStatus)lastMsgCodeReceived == CommandStatus::Complete) {
-        if (debugNukiCommunication) {
-          logMessage("************************ COMMAND SUCCESS ************************");
-        }
-        nukiCommandState = CommandState::Idle;
-        lastMsgCodeReceived = Command::Empty;
-        return Nuki::CmdResult::Success;
-      }
-      break;
-    }
-    default:
-      logMessage("Unknown request command state", 2);
-      disconnect();
-      return Nuki::CmdResult::Failed;
-      break;
   }
-  return Nuki::CmdResult::Working;
 }
-}
\ No newline at end of file
+}
@@ -0,0 +1,70 @@
+/**
+ * @file NukiConnectRetry.cpp
+ *
+ * Created: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ */
+
+#include "NukiConnectRetry.h"
+#include "esp_random.h"
+
+namespace Nuki {
+
+BackoffRetryPolicy::BackoffRetryPolicy(const uint32_t baseDelayMs, const uint32_t maxDelayMs)
+  : baseDelay(baseDelayMs),
+    maxDelay(maxDelayMs)
+{}
+
+uint32_t BackoffRetryPolicy::getRetryDelay(uint8_t retry) {
+  uint32_t delayMs = maxDelay;
+  if (retry > 0 && retry <= 16 && (baseDelay << (retry - 1)) < maxDelay) {
+    delayMs = baseDelay << (retry - 1);
+  }
+  return delayMs / 2 + esp_random() % (delayMs / 2 + 1);
+}
+
+void ConnectCircuitBreaker::setEnabled(const bool enable, const uint32_t staleTimeoutMs) {
+  enabled = enable;
+  staleTimeout = staleTimeoutMs;
+  if (!enable) {
+    state = CircuitState::Closed;
+  }
+}
+
+bool ConnectCircuitBreaker::isEnabled() const {
+  return enabled;
+}
+
+CircuitState ConnectCircuitBreaker::getState() const {
+  return state;
+}
+
+bool ConnectCircuitBreaker::checkStale(const uint32_t sinceAdvertisementMs, const uint32_t sinceLinkActivityMs) {
+  if (sinceAdvertisementMs > staleTimeout && sinceLinkActivityMs > staleTimeout) {
+    return state.exchange(CircuitState::Open) != CircuitState::Open;
+  }
+  return false;
+}
+
+uint8_t ConnectCircuitBreaker::getMaxAttempts(const uint8_t connectRetries) const {
+  return state == CircuitState::HalfOpen ? 1 : connectRetries;
+}
+
+bool ConnectCircuitBreaker::advertisementReceived() {
+  //called on the scan task
+  CircuitState openState = CircuitState::Open;
+  return state.compare_exchange_strong(openState, CircuitState::HalfOpen);
+}
+
+bool ConnectCircuitBreaker::connectSucceeded() {
+  CircuitState halfOpenState = CircuitState::HalfOpen;
+  return state.compare_exchange_strong(halfOpenState, CircuitState::Closed);
+}
+
+bool ConnectCircuitBreaker::connectFailed() {
+  CircuitState halfOpenState = CircuitState::HalfOpen;
+  return state.compare_exchange_strong(halfOpenState, CircuitState::Open);
+}
+
+} // namespace Nuki
@@ -0,0 +1,90 @@
+#pragma once
+
+/**
+ * @file NukiConnectRetry.h
+ * Delay between connect attempts and the connect circuit breaker
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * BackoffRetryPolicy doubles the delay per retry up to a maximum and randomizes the upper half, so
+ * devices sharing the radio do not retry in lockstep. ConnectCircuitBreaker holds the state machine of
+ * NukiBle::setCircuitBreaker(), the timestamps it is fed with are kept by the lock.
+ * Only depends on the C++ standard library and the ESP-IDF RNG, extras/connect_retry_test runs it on
+ * the host.
+ *
+ */
+
+#include <stdint.h>
+#include <atomic>
+
+#define CONNECT_BACKOFF_BASE 50
+#define CONNECT_BACKOFF_MAX 1000
+
+namespace Nuki {
+
+/**
+ * @brief Determines the delay between connect attempts, set with NukiBle::setConnectRetryPolicy()
+ */
+class ConnectRetryPolicy {
+  public:
+    virtual ~ConnectRetryPolicy() {};
+    virtual uint32_t getRetryDelay(uint8_t retry) = 0;
+};
+
+/**
+ * @brief Default connect retry policy, exponential backoff (base * 2^retry, capped at max) of which
+ * the upper half is randomized so devices sharing the radio do not retry in lockstep
+ */
+class BackoffRetryPolicy : public ConnectRetryPolicy {
+  public:
+    BackoffRetryPolicy(const uint32_t baseDelayMs = CONNECT_BACKOFF_BASE, const uint32_t maxDelayMs = CONNECT_BACKOFF_MAX);
+    uint32_t getRetryDelay(uint8_t retry) override;
+
+  private:
+    uint32_t baseDelay;
+    uint32_t maxDelay;
+};
+
+enum class CircuitState : uint8_t {
+  Closed    = 0,
+  Open      = 1,
+  HalfOpen  = 2
+};
+
+/**
+ * @brief Opens when the lock has not been heard of within the stale timeout, an advertisement half
+ * opens it and the probe connect then closes or reopens it. The transitions return true when the state
+ * changed, so the caller can log them.
+ */
+class ConnectCircuitBreaker {
+  public:
+    void setEnabled(const bool enable, const uint32_t staleTimeoutMs);
+    bool isEnabled() const;
+    CircuitState getState() const;
+
+    /**
+     * @brief Opens the circuit when neither an advertisement nor data over the link was received
+     * within the stale timeout
+     *
+     * @param sinceAdvertisementMs time since the last advertisement of the lock
+     * @param sinceLinkActivityMs time since data was last received over the link
+     */
+    bool checkStale(const uint32_t sinceAdvertisementMs, const uint32_t sinceLinkActivityMs);
+
+    /**
+     * @brief Number of connect attempts allowed, a half open circuit only allows a single probe
+     */
+    uint8_t getMaxAttempts(const uint8_t connectRetries) const;
+
+    bool advertisementReceived();
+    bool connectSucceeded();
+    bool connectFailed();
+
+  private:
+    bool enabled = false;
+    uint32_t staleTimeout = 0;
+    std::atomic<CircuitState> state{CircuitState::Closed};
+};
+
+} // namespace Nuki
@@ -23,6 +23,9 @@ const char SECRET_KEY_STORE_NAME[]       = "secretKeyK";
 const char AUTH_ID_STORE_NAME[]          = "authorizationId";
 const char ULTRA_PINCODE_STORE_NAME[]    = "ultraPinCode";
 const char ULTRA_STORE_NAME[]            = "isUltra";
+const char GATT_CACHE_STORE_NAME[]       = "gattCache";
+const char CONN_PROFILE_STORE_NAME[]     = "connProfile";
+const char LOG_CURSOR_STORE_NAME[]       = "logCursor";
 
 enum class DoorSensorState : uint8_t {
   Unavailable       = 0x00,
@@ -0,0 +1,44 @@
+#pragma once
+
+/**
+ * @file NukiCrc.h
+ * CRC-16/CCITT-FALSE of the messages exchanged with the lock
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * width=16 poly=0x1021 init=0xffff refin=false refout=false xorout=0x0000 check=0x29b1
+ * Table driven, one table lookup per byte (512 byte table in flash). Define NUKI_CRC_SLICING_BY_4 to
+ * process 4 bytes per step on messages of at least NUKI_CRC_SLICING_MIN_LEN bytes (e.g. log
+ * entries), at the cost of another 1.5 kB of tables.
+ * Only depends on the C library so it can be used on the host as well, extras/crc_bench verifies both
+ * variants against the bitwise Crc16 library calculation and measures their speed.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef NUKI_CRC_SLICING_MIN_LEN
+#define NUKI_CRC_SLICING_MIN_LEN 32
+#endif
+
+namespace Nuki {
+
+/**
+ * @brief Calculates the CRC-16/CCITT-FALSE, one byte per step
+ *
+ * @param data data
+ * @param len number of bytes
+ * @param crc CRC of the preceding data, 0xffff to start a new CRC
+ */
+uint16_t crc16CcittFalse(const uint8_t* data, size_t len, uint16_t crc = 0xffff);
+
+#ifdef NUKI_CRC_SLICING_BY_4
+/**
+ * @brief Calculates the CRC-16/CCITT-FALSE, four bytes per step, same result as crc16CcittFalse()
+ */
+uint16_t crc16CcittFalseSlicing4(const uint8_t* data, size_t len, uint16_t crc = 0xffff);
+#endif
+
+} // namespace Nuki
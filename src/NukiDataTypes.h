@@ -14,6 +14,7 @@
 
 #include "Arduino.h"
 #include "NukiConstants.h"
+#include "NukiConnectRetry.h"
 
 namespace Nuki {
 
@@ -21,7 +22,9 @@ enum class EventType {
   KeyTurnerStatusUpdated,
   KeyTurnerStatusReset,
   ERROR_BAD_PIN,
-  BLE_ERROR_ON_DISCONNECT
+  BLE_ERROR_ON_DISCONNECT,
+  KeyTurnerStatusRefreshed,
+  BatteryReportRefreshed
 };
 
 class SmartlockEventHandler {
@@ -36,7 +39,8 @@ enum CmdResult : uint8_t {
   TimeOut   = 3,
   Working   = 4,
   NotPaired = 5,
-  Lock_Busy = 6,
+  Lock_Busy = 6,     //the lock reported it is busy (error 69)
+  Busy      = 7,     //another command of this library is in progress on the lock
   Error     = 99
 };
 
@@ -61,7 +65,8 @@ enum class PairingState {
   Timeout           = 99
 };
 
-enum class CommandState {
+//no longer used by the library, commands are executed as a sequence of ProtocolStep
+enum class [[deprecated("commands are executed as a sequence of ProtocolStep")]] CommandState {
   Idle                  = 0,
   CmdReceived           = 1,
   ChallengeSent         = 2,
@@ -71,5 +76,97 @@ enum class CommandState {
   TimeOut               = 6
 };
 
+enum class ProtocolStep : uint8_t {
+  SendRequest           = 0,  //RequestData with the action payload
+  SendChallengeRequest  = 1,  //RequestData for a challenge
+  AwaitChallenge        = 2,
+  SendCommand           = 3,  //action command with payload and challenge nonce
+  SendCommandWithPin    = 4,  //action command with payload, challenge nonce and pincode
+  AwaitResponse         = 5,  //any message other than an error report
+  AwaitAccept           = 6   //status accepted (or complete when the lock skipped the action)
+};
+
+struct ProtocolDescriptor {
+  const ProtocolStep* steps;
+  uint8_t stepCount;
+};
+
+enum class ConnectionProfile : uint8_t {
+  StackDefault  = 0,
+  PowerSave     = 1,
+  Balanced      = 2,
+  LowLatency    = 3
+};
+
+struct ConnectionParameters {
+  uint16_t minInterval;         //units of 1.25ms
+  uint16_t maxInterval;         //units of 1.25ms
+  uint16_t latency;             //number of connection events the peripheral may skip
+  uint16_t supervisionTimeout;  //units of 10ms
+  uint16_t scanInterval;        //units of 0.625ms
+  uint16_t scanWindow;          //units of 0.625ms
+};
+
+struct ConnectionStats {
+  ConnectionProfile profile;
+  uint32_t connects;
+  uint32_t connectFailures;
+  uint32_t profileFallbacks;
+};
+
+struct CommandTimeout {
+  Command command;    //command sent in a protocol step or message waited for
+  uint16_t timeoutMs;
+  bool adaptive;      //replaced by the adaptive timeout derived from the round trip times
+};
+
+struct RoundTripStats {
+  uint16_t samples;
+  uint16_t p50;             //ms
+  uint16_t p99;             //ms
+  uint16_t adaptiveTimeout; //ms, 0 when not (yet) in use
+};
+
+struct LogSyncStats {
+  uint32_t cursor;          //index of the newest log entry synchronized
+  uint32_t entries;         //new entries received by the last sync
+  uint32_t missingEntries;  //entries skipped in the index sequence (ie overwritten on the lock)
+  bool resetDetected;       //the log on the lock restarted below the cursor, the cursor was reset
+};
+
+struct ProvisioningResult {
+  char deviceName[9];       //name (preferences namespace) the credentials are stored under
+  char address[18];         //BLE address of the lock
+  bool ultra;               //lock is a smart lock ultra
+  PairingResult result;     //Success or Timeout
+  uint32_t queuedMs;        //time from the first pairing advertisement to the start of pairing
+  uint32_t pairingMs;       //time from the start of pairing (connect) until the credentials are stored
+};
+
+struct ProvisioningStats {
+  uint32_t paired;          //locks paired since startProvisioning()
+  uint32_t failed;          //pairing attempts that timed out
+  uint32_t expired;         //queued locks that stopped advertising pairing mode before their turn
+  uint32_t elapsedMs;       //time since startProvisioning()
+  float locksPerHour;       //paired locks per hour over elapsedMs
+};
+
+template <typename TConfig, typename TAdvancedConfig>
+struct ConfigTransaction {
+  bool active = false;
+  bool configRead = false;
+  bool configChanged = false;
+  bool advancedConfigRead = false;
+  bool advancedConfigChanged = false;
+  TConfig config;
+  TAdvancedConfig advancedConfig;
+};
+
+struct __attribute__((packed)) GattHandleCache {
+  unsigned char bleAddress[6] = {0};
+  unsigned char firmwareVersion[3] = {0};
+  uint16_t usdioValueHandle = 0;
+  uint16_t usdioCccdHandle = 0;
+};
 
 } // namespace Nuki
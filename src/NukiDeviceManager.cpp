@@ -0,0 +1,232 @@
+#include "NukiDeviceManager.h"
+
+namespace Nuki {
+
+NukiDeviceManager::NukiDeviceManager(const uint8_t maxConnections)
+  : maxConnections(maxConnections) {
+  clients.reserve(maxConnections);
+  poolMutex = xSemaphoreCreateMutex();
+  connectMutex = xSemaphoreCreateMutex();
+}
+
+NukiDeviceManager::~NukiDeviceManager() {
+  while (!devices.empty()) {
+    removeDevice(devices.back());
+  }
+
+  vSemaphoreDelete(poolMutex);
+  vSemaphoreDelete(connectMutex);
+}
+
+void NukiDeviceManager::registerBleScanner(BleScanner::Publisher* bleScanner) {
+  this->bleScanner = bleScanner;
+}
+
+void NukiDeviceManager::addDevice(NukiBle* device) {
+  xSemaphoreTake(poolMutex, portMAX_DELAY);
+  devices.push_back(device);
+  device->deviceManager = this;
+  xSemaphoreGive(poolMutex);
+}
+
+void NukiDeviceManager::removeDevice(NukiBle* device) {
+  //waits for a running command or a reclaim of the client by another device
+  bool slotClaimed = device->claimCommandSlot(COMMAND_SLOT_TIMEOUT);
+  bool owned = false;
+
+  xSemaphoreTake(poolMutex, portMAX_DELAY);
+  for (auto it = devices.begin(); it != devices.end(); it++) {
+    if (*it == device) {
+      devices.erase(it);
+      break;
+    }
+  }
+
+  for (ClientSlot& slot : clients) {
+    if (slot.owner == device && !slot.reclaiming) {
+      slot.reclaiming = true;
+      owned = true;
+    }
+    if (slot.lastOwner == device) {
+      slot.lastOwner = nullptr;
+    }
+  }
+  device->deviceManager = nullptr;
+  xSemaphoreGive(poolMutex);
+
+  if (owned) {
+    //disconnect outside poolMutex, the slot is not handed out before it is released below
+    device->releaseClient();
+
+    xSemaphoreTake(poolMutex, portMAX_DELAY);
+    for (ClientSlot& slot : clients) {
+      if (slot.owner == device) {
+        slot.owner = nullptr;
+        slot.reclaiming = false;
+      }
+    }
+    xSemaphoreGive(poolMutex);
+  }
+
+  if (slotClaimed) {
+    device->releaseCommandSlot();
+  }
+}
+
+uint8_t NukiDeviceManager::getActiveClients() {
+  uint8_t activeClients = 0;
+
+  xSemaphoreTake(poolMutex, portMAX_DELAY);
+  for (ClientSlot& slot : clients) {
+    if (slot.owner != nullptr) {
+      activeClients++;
+    }
+  }
+  xSemaphoreGive(poolMutex);
+  return activeClients;
+}
+
+void NukiDeviceManager::setConnectSlotTimeout(const uint32_t timeoutMs) {
+  connectSlotTimeout = timeoutMs;
+}
+
+BLEClient* NukiDeviceManager::acquireClient(NukiBle* device) {
+  BLEClient* client = nullptr;
+  #ifndef NUKI_64BIT_TIME
+  uint32_t start = millis();
+  #else
+  int64_t start = (esp_timer_get_time() / 1000);
+  #endif
+
+  while (true) {
+    //prefer a free or disconnected client, only disconnect an idle device when there is no other option
+    if (tryAcquireClient(device, false, &client) || tryAcquireClient(device, true, &client)) {
+      return client;
+    }
+
+    #ifndef NUKI_64BIT_TIME
+    if (millis() - start > connectSlotTimeout) {
+    #else
+    if ((esp_timer_get_time() / 1000) - start > connectSlotTimeout) {
+    #endif
+      return nullptr;
+    }
+
+    #ifndef NUKI_NO_WDT_RESET
+    esp_task_wdt_reset();
+    #endif
+    delay(CONNECT_SLOT_RETRY_INTERVAL);
+  }
+}
+
+bool NukiDeviceManager::tryAcquireClient(NukiBle* device, bool disconnectIdle, BLEClient** client) {
+  ClientSlot* acquired = nullptr;
+  NukiBle* idleOwner = nullptr;
+
+  xSemaphoreTake(poolMutex, portMAX_DELAY);
+  for (ClientSlot& slot : clients) {
+    if (slot.owner == device) {
+      if (slot.reclaiming) {
+        //taken by another device right now, the owner has to get a client again
+        xSemaphoreGive(poolMutex);
+        return false;
+      }
+      *client = slot.client;
+      xSemaphoreGive(poolMutex);
+      return true;
+    }
+  }
+
+  for (ClientSlot& slot : clients) {
+    if (slot.owner == nullptr) {
+      acquired = &slot;
+      break;
+    }
+  }
+
+  if (acquired == nullptr && clients.size() < maxConnections) {
+    BLEClient* newClient = NimBLEDevice::createClient();
+    if (newClient != nullptr) {
+      clients.push_back({newClient, nullptr, nullptr, false});
+      acquired = &clients.back();
+    }
+  }
+
+  if (acquired == nullptr) {
+    for (ClientSlot& slot : clients) {
+      if (!slot.reclaiming && slot.owner->claimIdleClient(disconnectIdle)) {
+        slot.reclaiming = true;
+        idleOwner = slot.owner;
+        break;
+      }
+    }
+  }
+
+  if (acquired != nullptr) {
+    assignClient(acquired, device);
+    *client = acquired->client;
+  }
+  xSemaphoreGive(poolMutex);
+
+  if (idleOwner == nullptr) {
+    return acquired != nullptr;
+  }
+
+  //disconnecting the idle device can take up to DISCONNECT_TIMEOUT, the other devices can use the
+  //pool in the meantime. The idle device holds off its own use of the client until it is released.
+  bool reclaimed = idleOwner->reclaimClient();
+
+  xSemaphoreTake(poolMutex, portMAX_DELAY);
+  for (ClientSlot& slot : clients) {
+    if (slot.reclaiming && slot.owner == idleOwner) {
+      slot.reclaiming = false;
+      if (reclaimed) {
+        assignClient(&slot, device);
+        *client = slot.client;
+        acquired = &slot;
+      }
+      break;
+    }
+  }
+  xSemaphoreGive(poolMutex);
+  idleOwner->releaseCommandSlot();
+  return acquired != nullptr;
+}
+
+void NukiDeviceManager::assignClient(ClientSlot* slot, NukiBle* device) {
+  //the attributes discovered by another device are not valid for this device
+  device->attachClient(slot->client, slot->lastOwner != device);
+  slot->owner = device;
+  slot->lastOwner = device;
+}
+
+void NukiDeviceManager::beginConnect() {
+  //NimBLE handles only one connection setup at a time
+  xSemaphoreTake(connectMutex, portMAX_DELAY);
+}
+
+void NukiDeviceManager::endConnect() {
+  xSemaphoreGive(connectMutex);
+}
+
+void NukiDeviceManager::pauseScanning(NukiBle* device) {
+  BleScanner::Publisher* scanner = bleScanner != nullptr ? bleScanner : device->bleScanner;
+
+  xSemaphoreTake(poolMutex, portMAX_DELAY);
+  if (scanPauseCount++ == 0 && scanner != nullptr) {
+    scanner->enableScanning(false);
+  }
+  xSemaphoreGive(poolMutex);
+}
+
+void NukiDeviceManager::resumeScanning(NukiBle* device) {
+  BleScanner::Publisher* scanner = bleScanner != nullptr ? bleScanner : device->bleScanner;
+
+  xSemaphoreTake(poolMutex, portMAX_DELAY);
+  if (scanPauseCount > 0 && --scanPauseCount == 0 && scanner != nullptr) {
+    scanner->enableScanning(true);
+  }
+  xSemaphoreGive(poolMutex);
+}
+
+} // namespace Nuki
@@ -0,0 +1,104 @@
+#pragma once
+
+/**
+ * @file NukiDeviceManager.h
+ * Shares the NimBLE clients and the scanner between multiple Nuki devices
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * NimBLE only supports a limited number of simultaneous connections (and clients), when more
+ * locks/openers than that are controlled from one ESP the clients are leased to a device for the
+ * duration of a connection. Connection setup is serialized and scanning is paused as long as any
+ * device is connecting.
+ *
+ */
+
+#include "NukiBle.h"
+#include "freertos/semphr.h"
+#include <vector>
+
+#ifdef CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#define NUKI_MAX_CONNECTIONS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#else
+#define NUKI_MAX_CONNECTIONS 3
+#endif
+#define CONNECT_SLOT_TIMEOUT 10000
+#define CONNECT_SLOT_RETRY_INTERVAL 100
+
+namespace Nuki {
+
+class NukiDeviceManager {
+  public:
+    /**
+     * @brief Construct a new Nuki Device Manager
+     *
+     * @param maxConnections maximum number of simultaneous connections, should not exceed the
+     * NimBLE connection limit minus connections used elsewhere in the application
+     */
+    NukiDeviceManager(const uint8_t maxConnections = NUKI_MAX_CONNECTIONS);
+    ~NukiDeviceManager();
+
+    /**
+     * @brief Registers the scanner shared by all devices, scanning is paused while any of the
+     * devices is connecting
+     *
+     * @param bleScanner the scanner
+     */
+    void registerBleScanner(BleScanner::Publisher* bleScanner);
+
+    /**
+     * @brief Adds a device to be managed, has to be called before initialize() of the device
+     *
+     * @param device the lock or opener
+     */
+    void addDevice(NukiBle* device);
+
+    /**
+     * @brief Removes a device, its client is returned to the pool
+     *
+     * @param device the lock or opener
+     */
+    void removeDevice(NukiBle* device);
+
+    /**
+     * @brief Returns the number of clients currently leased to a device
+     */
+    uint8_t getActiveClients();
+
+    /**
+     * @brief Set the time a device waits for a free connection slot before the connect fails
+     *
+     * @param timeoutMs timeout in milliseconds
+     */
+    void setConnectSlotTimeout(const uint32_t timeoutMs);
+
+  private:
+    friend class NukiBle;
+
+    struct ClientSlot {
+      BLEClient* client;
+      NukiBle* owner;
+      NukiBle* lastOwner;
+      bool reclaiming;    //the client is being taken from its idle owner, outside poolMutex
+    };
+
+    BLEClient* acquireClient(NukiBle* device);
+    bool tryAcquireClient(NukiBle* device, bool disconnectIdle, BLEClient** client);
+    void assignClient(ClientSlot* slot, NukiBle* device);
+    void beginConnect();
+    void endConnect();
+    void pauseScanning(NukiBle* device);
+    void resumeScanning(NukiBle* device);
+
+    std::vector<ClientSlot> clients;
+    std::vector<NukiBle*> devices;
+    uint8_t maxConnections;
+    uint32_t connectSlotTimeout = CONNECT_SLOT_TIMEOUT;
+    SemaphoreHandle_t poolMutex = nullptr;
+    SemaphoreHandle_t connectMutex = nullptr;
+    BleScanner::Publisher* bleScanner = nullptr;
+    uint8_t scanPauseCount = 0;
+};
+
+} // namespace Nuki
@@ -0,0 +1,123 @@
+#pragma once
+
+/**
+ * @file NukiEntryBuffer.h
+ * Fixed capacity storage for the entries (log, keypad, authorization, ...) received from the lock
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * The entries are stored in one block of NUKI_ENTRY_CAPACITY entries which is allocated on first
+ * use and reused for every retrieval, so large retrievals do not fragment the heap. Keypad codes and
+ * authorizations are stored up to the number a lock can hold (NUKI_KEYPAD_ENTRY_CAPACITY and
+ * NUKI_AUTHORIZATION_ENTRY_CAPACITY), so retrieving all of them is never truncated.
+ * - NUKI_ENTRY_STORAGE_STATIC: the block is part of the object instead of being allocated
+ * - NUKI_ENTRY_STORAGE_PSRAM: the block is allocated in PSRAM when available
+ * Entries received when the buffer is full are dropped and counted (getDroppedEntries() of the lock),
+ * use the streaming callbacks of the retrieve methods for retrievals larger than the capacity.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef NUKI_ENTRY_STORAGE_PSRAM
+#include "esp_heap_caps.h"
+#endif
+
+#ifndef NUKI_ENTRY_CAPACITY
+#define NUKI_ENTRY_CAPACITY 100
+#endif
+//a keypad 2 holds up to 200 codes
+#ifndef NUKI_KEYPAD_ENTRY_CAPACITY
+#define NUKI_KEYPAD_ENTRY_CAPACITY 200
+#endif
+//a lock holds up to 200 authorizations
+#ifndef NUKI_AUTHORIZATION_ENTRY_CAPACITY
+#define NUKI_AUTHORIZATION_ENTRY_CAPACITY 200
+#endif
+
+namespace Nuki {
+
+template <typename T, size_t Capacity = NUKI_ENTRY_CAPACITY>
+class EntryBuffer {
+  public:
+    EntryBuffer() = default;
+    EntryBuffer(const EntryBuffer&) = delete;
+    EntryBuffer& operator=(const EntryBuffer&) = delete;
+
+    ~EntryBuffer() {
+      #ifndef NUKI_ENTRY_STORAGE_STATIC
+      free(entries);
+      #endif
+    }
+
+    /**
+     * @brief Appends an entry
+     *
+     * @return false if the buffer is full (or could not be allocated), the entry is dropped
+     */
+    bool push_back(const T& entry) {
+      if (count >= Capacity || !allocate()) {
+        dropped++;
+        return false;
+      }
+      entries[count++] = entry;
+      return true;
+    }
+
+    void clear() {
+      count = 0;
+      dropped = 0;
+    }
+
+    size_t size() const {
+      return count;
+    }
+
+    constexpr size_t capacity() const {
+      return Capacity;
+    }
+
+    /**
+     * @brief Returns the number of entries dropped since the last clear() because the buffer was full
+     */
+    uint32_t getDropped() const {
+      return dropped;
+    }
+
+    const T* begin() const {
+      return entries;
+    }
+
+    const T* end() const {
+      return entries + count;
+    }
+
+  private:
+    #ifdef NUKI_ENTRY_STORAGE_STATIC
+    bool allocate() {
+      return true;
+    }
+
+    T entries[Capacity];
+    #else
+    bool allocate() {
+      if (entries == nullptr) {
+        #ifdef NUKI_ENTRY_STORAGE_PSRAM
+        entries = (T*)heap_caps_malloc(sizeof(T) * Capacity, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        #endif
+        if (entries == nullptr) {
+          entries = (T*)malloc(sizeof(T) * Capacity);
+        }
+      }
+      return entries != nullptr;
+    }
+
+    T* entries = nullptr;
+    #endif
+    size_t count = 0;
+    uint32_t dropped = 0;
+};
+
+} // namespace Nuki
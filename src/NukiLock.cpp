@@ -3,6 +3,28 @@
 #include "NukiUtils.h"
 
 namespace NukiLock {
+
+//payloads decoded into a data type by decodeReturnPayload()
+static constexpr Nuki::PayloadSize payloadSizes[] = {
+  Nuki::payloadSizeFrom<KeyTurnerState>((uint16_t)Command::KeyturnerStates, offsetof(KeyTurnerState, configUpdateCount)),
+  Nuki::payloadSizeOf<BatteryReport>((uint16_t)Command::BatteryReport),
+  Nuki::payloadSizeFrom<Config>((uint16_t)Command::Config, offsetof(Config, singleLock)),
+  Nuki::payloadSizeFrom<AdvancedConfig>((uint16_t)Command::AdvancedConfig, offsetof(AdvancedConfig, lockNgoTimeout)),
+  Nuki::payloadSizeOf<TimeControlEntry>((uint16_t)Command::TimeControlEntry),
+  Nuki::payloadSizeFrom<LogEntry>((uint16_t)Command::LogEntry, offsetof(LogEntry, data)),
+  Nuki::payloadSizeOf<InternalLogEntry>((uint16_t)Command::InternalLogEntry),
+  Nuki::payloadSizeOf<MqttConfig>((uint16_t)Command::MqttConfig),
+  Nuki::payloadSizeOf<MqttConfigForMigration>((uint16_t)Command::MqttConfigForMigration),
+  Nuki::payloadSizeOf<WifiScanEntry>((uint16_t)Command::WifiScanEntry),
+  Nuki::payloadSizeOf<WifiConfig>((uint16_t)Command::WifiConfig),
+  Nuki::payloadSizeOf<WifiConfigForMigration>((uint16_t)Command::WifiConfigForMigration),
+  Nuki::payloadSizeOf<Keypad2Config>((uint16_t)Command::Keypad2Config),
+  Nuki::payloadSizeOf<GeneralStatistics>((uint16_t)Command::GeneralStatistics),
+  Nuki::payloadSizeOf<DailyStatistics>((uint16_t)Command::DailyStatistics),
+  Nuki::payloadSizeOf<AccessoryInfo>((uint16_t)Command::AccessoryInfo),
+  Nuki::payloadSizeOf<DoorSensorConfig>((uint16_t)Command::DoorSensorConfig)
+};
+
 NukiLock::NukiLock(const std::string& deviceName, const uint32_t deviceId)
   : NukiBle(deviceName,
             deviceId,
@@ -18,6 +40,19 @@ NukiLock::NukiLock(const std::string& deviceName, const uint32_t deviceId)
 
 Nuki::CmdResult NukiLock::lockAction(const LockAction lockAction, const uint32_t nukiAppId, const uint8_t flags, const char* nameSuffix, const uint8_t nameSuffixLen) {
   Action action;
+  createLockAction(&action, lockAction, nukiAppId, flags, nameSuffix, nameSuffixLen);
+  return executeAction(action);
+}
+
+Nuki::CmdHandle NukiLock::lockActionAsync(const LockAction lockAction, Nuki::CmdCallback callback, const uint32_t nukiAppId, const uint8_t flags,
+    const char* nameSuffix, const uint8_t nameSuffixLen) {
+  Action action;
+  createLockAction(&action, lockAction, nukiAppId, flags, nameSuffix, nameSuffixLen);
+  return submit(action, callback);
+}
+
+void NukiLock::createLockAction(Action* action, const LockAction lockAction, const uint32_t nukiAppId, const uint8_t flags,
+                                const char* nameSuffix, const uint8_t nameSuffixLen) {
   unsigned char payload[sizeof(LockAction) + 4 + 1 + 20] = {0};
   memcpy(payload, &lockAction, sizeof(LockAction));
   memcpy(&payload[sizeof(LockAction)], &nukiAppId, 4);
@@ -33,12 +68,10 @@ Nuki::CmdResult NukiLock::lockAction(const LockAction lockAction, const uint32_t
     payloadLen = sizeof(LockAction) + 4 + 1;
   }
 
-  action.cmdType = Nuki::CommandType::CommandWithChallengeAndAccept;
-  action.command = Command::LockAction;
-  memcpy(action.payload, &payload, payloadLen);
-  action.payloadLen = payloadLen;
-
-  return executeAction(action);
+  action->cmdType = Nuki::CommandType::CommandWithChallengeAndAccept;
+  action->command = Command::LockAction;
+  memcpy(action->payload, &payload, payloadLen);
+  action->payloadLen = payloadLen;
 }
 
 Nuki::CmdResult NukiLock::keypadAction(KeypadActionSource source, uint32_t code, KeypadAction keypadAction) {
@@ -73,6 +106,18 @@ Nuki::CmdResult NukiLock::requestKeyTurnerState(KeyTurnerState* retrievedKeyTurn
   return result;
 }
 
+Nuki::CmdHandle NukiLock::requestKeyTurnerStateAsync(Nuki::CmdCallback callback) {
+  Action action;
+  uint16_t payload = (uint16_t)Command::KeyturnerStates;
+
+  action.cmdType = Nuki::CommandType::Command;
+  action.command = Command::RequestData;
+  memcpy(&action.payload[0], &payload, sizeof(payload));
+  action.payloadLen = sizeof(payload);
+
+  return submit(action, callback);
+}
+
 void NukiLock::retrieveKeyTunerState(KeyTurnerState* retrievedKeyTurnerState) {
   memcpy(retrievedKeyTurnerState, &keyTurnerState, sizeof(KeyTurnerState));
 }
@@ -94,8 +139,42 @@ Nuki::CmdResult NukiLock::requestBatteryReport(BatteryReport* retrievedBatteryRe
   return result;
 }
 
+Nuki::CmdHandle NukiLock::requestBatteryReportAsync(Nuki::CmdCallback callback) {
+  Action action;
+  uint16_t payload = (uint16_t)Command::BatteryReport;
+
+  memset(&action, 0, sizeof(action));
+  action.cmdType = Nuki::CommandType::Command;
+  action.command = Command::RequestData;
+  memcpy(&action.payload[0], &payload, sizeof(payload));
+  action.payloadLen = sizeof(payload);
+
+  return submit(action, callback);
+}
+
+void NukiLock::retrieveBatteryReport(BatteryReport* retrievedBatteryReport) {
+  memcpy(retrievedBatteryReport, &batteryReport, sizeof(BatteryReport));
+}
+
+Nuki::CmdHandle NukiLock::requestStateAsync(Nuki::CmdCallback callback) {
+  return requestKeyTurnerStateAsync(callback);
+}
+
 
 Nuki::CmdResult NukiLock::requestConfig(Config* retrievedConfig) {
+  if (configTransaction.active && configTransaction.configRead) {
+    memcpy(retrievedConfig, &configTransaction.config, sizeof(Config));
+    return Nuki::CmdResult::Success;
+  }
+  if (configCacheEnabled && configCacheValid) {
+    memcpy(retrievedConfig, &config, sizeof(Config));
+    if (configTransaction.active) {
+      memcpy(&configTransaction.config, &config, sizeof(Config));
+      configTransaction.configRead = true;
+    }
+    return Nuki::CmdResult::Success;
+  }
+
   Action action;
 
   memset(&action, 0, sizeof(action));
@@ -105,11 +184,28 @@ Nuki::CmdResult NukiLock::requestConfig(Config* retrievedConfig) {
   Nuki::CmdResult result = executeAction(action);
   if (result == Nuki::CmdResult::Success) {
     memcpy(retrievedConfig, &config, sizeof(Config));
+    if (configTransaction.active) {
+      memcpy(&configTransaction.config, &config, sizeof(Config));
+      configTransaction.configRead = true;
+    }
   }
   return result;
 }
 
 Nuki::CmdResult NukiLock::requestAdvancedConfig(AdvancedConfig* retrievedAdvancedConfig) {
+  if (configTransaction.active && configTransaction.advancedConfigRead) {
+    memcpy(retrievedAdvancedConfig, &configTransaction.advancedConfig, sizeof(AdvancedConfig));
+    return Nuki::CmdResult::Success;
+  }
+  if (configCacheEnabled && advancedConfigCacheValid) {
+    memcpy(retrievedAdvancedConfig, &advancedConfig, sizeof(AdvancedConfig));
+    if (configTransaction.active) {
+      memcpy(&configTransaction.advancedConfig, &advancedConfig, sizeof(AdvancedConfig));
+      configTransaction.advancedConfigRead = true;
+    }
+    return Nuki::CmdResult::Success;
+  }
+
   Action action;
 
   memset(&action, 0, sizeof(action));
@@ -119,6 +215,98 @@ Nuki::CmdResult NukiLock::requestAdvancedConfig(AdvancedConfig* retrievedAdvance
   Nuki::CmdResult result = executeAction(action);
   if (result == Nuki::CmdResult::Success) {
     memcpy(retrievedAdvancedConfig, &advancedConfig, sizeof(AdvancedConfig));
+    if (configTransaction.active) {
+      memcpy(&configTransaction.advancedConfig, &advancedConfig, sizeof(AdvancedConfig));
+      configTransaction.advancedConfigRead = true;
+    }
+  }
+  return result;
+}
+
+void NukiLock::beginConfigTransaction() {
+  configTransaction.active = true;
+  configTransaction.configRead = false;
+  configTransaction.configChanged = false;
+  configTransaction.advancedConfigRead = false;
+  configTransaction.advancedConfigChanged = false;
+}
+
+Nuki::CmdResult NukiLock::commitConfigTransaction() {
+  Nuki::CmdResult result = Nuki::CmdResult::Success;
+  configTransaction.active = false;
+
+  if (configTransaction.configChanged) {
+    result = setFromConfig(configTransaction.config);
+    if (result == Nuki::CmdResult::Success) {
+      configTransaction.configChanged = false;
+    }
+  }
+  if (result == Nuki::CmdResult::Success && configTransaction.advancedConfigChanged) {
+    result = setFromAdvancedConfig(configTransaction.advancedConfig);
+    if (result == Nuki::CmdResult::Success) {
+      configTransaction.advancedConfigChanged = false;
+    }
+  }
+  //the changes not sent are kept, the transaction stays open to commit again or abort
+  configTransaction.active = result != Nuki::CmdResult::Success;
+  return result;
+}
+
+void NukiLock::abortConfigTransaction() {
+  configTransaction.active = false;
+  configTransaction.configChanged = false;
+  configTransaction.advancedConfigChanged = false;
+}
+
+Nuki::CmdResult NukiLock::requestStatus(KeyTurnerState* retrievedKeyTurnerState, BatteryReport* retrievedBatteryReport,
+                                      Config* retrievedConfig, AdvancedConfig* retrievedAdvancedConfig) {
+  Action actions[4];
+  Nuki::CmdResult results[4];
+  uint8_t count = 0;
+  uint16_t payload = 0;
+
+  memset(actions, 0, sizeof(actions));
+  if (retrievedKeyTurnerState) {
+    payload = (uint16_t)Command::KeyturnerStates;
+    actions[count].cmdType = Nuki::CommandType::Command;
+    actions[count].command = Command::RequestData;
+    memcpy(&actions[count].payload[0], &payload, sizeof(payload));
+    actions[count].payloadLen = sizeof(payload);
+    count++;
+  }
+  if (retrievedBatteryReport) {
+    payload = (uint16_t)Command::BatteryReport;
+    actions[count].cmdType = Nuki::CommandType::Command;
+    actions[count].command = Command::RequestData;
+    memcpy(&actions[count].payload[0], &payload, sizeof(payload));
+    actions[count].payloadLen = sizeof(payload);
+    count++;
+  }
+  if (retrievedConfig) {
+    actions[count].cmdType = Nuki::CommandType::CommandWithChallenge;
+    actions[count].command = Command::RequestConfig;
+    count++;
+  }
+  if (retrievedAdvancedConfig) {
+    actions[count].cmdType = Nuki::CommandType::CommandWithChallenge;
+    actions[count].command = Command::RequestAdvancedConfig;
+    count++;
+  }
+
+  Nuki::CmdResult result = executeBatch(actions, count, results);
+
+  uint8_t i = 0;
+  if (retrievedKeyTurnerState && results[i++] == Nuki::CmdResult::Success) {
+    memcpy(retrievedKeyTurnerState, &keyTurnerState, sizeof(KeyTurnerState));
+  }
+  if (retrievedBatteryReport && results[i++] == Nuki::CmdResult::Success) {
+    memcpy(retrievedBatteryReport, &batteryReport, sizeof(BatteryReport));
+  }
+  if (retrievedConfig && results[i++] == Nuki::CmdResult::Success) {
+    memcpy(retrievedConfig, &config, sizeof(Config));
+  }
+  if (retrievedAdvancedConfig && results[i++] == Nuki::CmdResult::Success) {
+    memcpy(retrievedAdvancedConfig, &advancedConfig, sizeof(AdvancedConfig));
   }
   return result;
 }
@@ -574,13 +762,17 @@ Nuki::CmdResult NukiLock::scanWifi(uint8_t scanDurationSeconds) {
 
 void NukiLock::getWifiScanEntries(std::list<WifiScanEntry>* wifiScanEntries) {
   wifiScanEntries->clear();
-  std::list<WifiScanEntry>::iterator it = listOfWifiScanEntries.begin();
+  auto it = listOfWifiScanEntries.begin();
   while (it != listOfWifiScanEntries.end()) {
     wifiScanEntries->push_back(*it);
     it++;
   }
 }
 
+const Nuki::EntryBuffer<WifiScanEntry>& NukiLock::getWifiScanEntries() const {
+  return listOfWifiScanEntries;
+}
+
 Nuki::CmdResult NukiLock::addTimeControlEntry(NewTimeControlEntry newTimeControlEntry) {
 //TODO verify data validity
   Action action;
@@ -653,13 +845,17 @@ Nuki::CmdResult NukiLock::retrieveTimeControlEntries() {
 
 void NukiLock::getTimeControlEntries(std::list<TimeControlEntry>* requestedTimeControlEntries) {
   requestedTimeControlEntries->clear();
-  std::list<TimeControlEntry>::iterator it = listOfTimeControlEntries.begin();
+  auto it = listOfTimeControlEntries.begin();
   while (it != listOfTimeControlEntries.end()) {
     requestedTimeControlEntries->push_back(*it);
     it++;
   }
 }
 
+const Nuki::EntryBuffer<TimeControlEntry>& NukiLock::getTimeControlEntries() const {
+  return listOfTimeControlEntries;
+}
+
 void NukiLock::getLogEntries(std::list<LogEntry>* requestedLogEntries) {
   requestedLogEntries->clear();
 
@@ -668,6 +864,10 @@ void NukiLock::getLogEntries(std::list<LogEntry>* requestedLogEntries) {
   }
 }
 
+const Nuki::EntryBuffer<LogEntry>& NukiLock::getLogEntries() const {
+  return listOfLogEntries;
+}
+
 void NukiLock::getInternalLogEntries(std::list<InternalLogEntry>* requestedInternalLogEntries) {
   requestedInternalLogEntries->clear();
 
@@ -676,7 +876,12 @@ void NukiLock::getInternalLogEntries(std::list<InternalLogEntry>* requestedInter
   }
 }
 
-Nuki::CmdResult NukiLock::retrieveLogEntries(const uint32_t startIndex, const uint16_t count, const uint8_t sortOrder, bool const totalCount) {
+const Nuki::EntryBuffer<InternalLogEntry>& NukiLock::getInternalLogEntries() const {
+  return listOfInternalLogEntries;
+}
+
+Nuki::CmdResult NukiLock::retrieveLogEntries(const uint32_t startIndex, const uint16_t count, const uint8_t sortOrder, bool const totalCount,
+    LogEntryCallback callback) {
   Action action;
   unsigned char payload[8] = {0};
   memcpy(payload, &startIndex, 4);
@@ -690,10 +895,24 @@ Nuki::CmdResult NukiLock::retrieveLogEntries(const uint32_t startIndex, const ui
   action.payloadLen = sizeof(payload);
 
   listOfLogEntries.clear();
+  logEntryCallback = callback;
 
   return executeAction(action);
 }
 
+Nuki::CmdResult NukiLock::syncLogEntries(LogEntryCallback callback, const uint16_t pageSize) {
+  logSyncCallback = callback;
+  return syncLog(pageSize);
+}
+
+Nuki::CmdResult NukiLock::requestLogPage(const uint32_t startIndex, const uint16_t count, const uint8_t sortOrder) {
+  return retrieveLogEntries(startIndex, count, sortOrder, false, [this](const LogEntry& logEntry) {
+    if (acceptLogEntry(logEntry.index) && logSyncCallback) {
+      logSyncCallback(logEntry);
+    }
+  });
+}
+
 Nuki::CmdResult NukiLock::getAccessoryInfo(const uint8_t accessoryType) {
   Action action;
   unsigned char payload[1] = {0};
@@ -743,7 +962,7 @@ uint8_t NukiLock::getBatteryPerc() {
 }
 
 const ErrorCode NukiLock::getLastError() const {
-  return (ErrorCode)errorCode;
+  return (ErrorCode)errorCode.load();
 }
 
 Nuki::CmdResult NukiLock::setConfig(NewConfig newConfig) {
@@ -756,16 +975,32 @@ Nuki::CmdResult NukiLock::setConfig(NewConfig newConfig) {
   memcpy(action.payload, &payload, sizeof(payload));
   action.payloadLen = sizeof(payload);
 
+  //the lock changes the config update count, read the config again on the next request
+  configCacheValid = false;
   return executeAction(action);
 }
 
 Nuki::CmdResult NukiLock::setFromConfig(const Config config) {
+  if (configTransaction.active) {
+    memcpy(&configTransaction.config, &config, sizeof(Config));
+    configTransaction.configRead = true;
+    configTransaction.configChanged = true;
+    return Nuki::CmdResult::Success;
+  }
+
   NewConfig newConfig;
   createNewConfig(&config, &newConfig);
   return setConfig(newConfig);
 }
 
 Nuki::CmdResult NukiLock::setFromAdvancedConfig(const AdvancedConfig config) {
+  if (configTransaction.active) {
+    memcpy(&configTransaction.advancedConfig, &config, sizeof(AdvancedConfig));
+    configTransaction.advancedConfigRead = true;
+    configTransaction.advancedConfigChanged = true;
+    return Nuki::CmdResult::Success;
+  }
+
   NewAdvancedConfig newConfig;
   createNewAdvancedConfig(&config, &newConfig);
   return setAdvancedConfig(newConfig);
@@ -787,6 +1022,7 @@ Nuki::CmdResult NukiLock::setAdvancedConfig(NewAdvancedConfig newAdvancedConfig)
     memcpy(action.payload, &payload, sizeof(payload));
     action.payloadLen = sizeof(payload);
   }
+  advancedConfigCacheValid = false;
   return executeAction(action);
 }
 
@@ -837,13 +1073,19 @@ void NukiLock::createNewAdvancedConfig(const AdvancedConfig* oldConfig, NewAdvan
   newConfig->enableSlowSpeedDuringNightMode = oldConfig->enableSlowSpeedDuringNightMode;  
 }
 
+const Nuki::PayloadSize* NukiLock::findExpectedPayloadSize(const Command returnCode) const {
+  const Nuki::PayloadSize* expected = Nuki::findPayloadSize(payloadSizes, sizeof(payloadSizes) / sizeof(payloadSizes[0]), (uint16_t)returnCode);
+  return expected != nullptr ? expected : NukiBle::findExpectedPayloadSize(returnCode);
+}
+
 void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint16_t dataLen) {
   extendDisconnectTimeout();
 
   switch (returnCode) {
     case Command::KeyturnerStates : {
       printBuffer((byte*)data, dataLen, false, "keyturnerStates", debugNukiHexData, logger);
-      memcpy(&keyTurnerState, data, dataLen);
+      decodeReturnPayload(returnCode, &keyTurnerState, data, dataLen);
+      checkConfigUpdateCount(keyTurnerState.configUpdateCount);
       if (debugNukiReadableData) {
         logKeyturnerState(keyTurnerState, true, logger);
       }
@@ -851,14 +1093,16 @@ void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint
     }
     case Command::BatteryReport : {
       printBuffer((byte*)data, dataLen, false, "batteryReport", debugNukiHexData, logger);
-      memcpy(&batteryReport, data, dataLen);
+      decodeReturnPayload(returnCode, &batteryReport, data, dataLen);
       if (debugNukiReadableData) {
         logBatteryReport(batteryReport, true, logger);
       }
       break;
     }
     case Command::Config : {
-      memcpy(&config, data, dataLen);
+      decodeReturnPayload(returnCode, &config, data, dataLen);
+      configCacheValid = true;
+      updateGattCacheFirmwareVersion(config.firmwareVersion);
       if (debugNukiReadableData) {
         logConfig(config, true, logger);
       }
@@ -866,7 +1110,8 @@ void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint
       break;
     }
     case Command::AdvancedConfig : {
-      memcpy(&advancedConfig, data, dataLen);
+      decodeReturnPayload(returnCode, &advancedConfig, data, dataLen);
+      advancedConfigCacheValid = true;
       if (debugNukiReadableData) {
         logAdvancedConfig(advancedConfig, true, logger);
       }
@@ -876,15 +1121,21 @@ void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint
     case Command::TimeControlEntry : {
       printBuffer((byte*)data, dataLen, false, "timeControlEntry", debugNukiHexData, logger);
       TimeControlEntry timeControlEntry;
-      memcpy(&timeControlEntry, data, dataLen);
-      listOfTimeControlEntries.push_back(timeControlEntry);
+      decodeReturnPayload(returnCode, &timeControlEntry, data, dataLen);
+      if (!listOfTimeControlEntries.push_back(timeControlEntry)) {
+        entryDropped();
+      }
       break;
     }
     case Command::LogEntry : {
       printBuffer((byte*)data, dataLen, false, "logEntry", debugNukiHexData, logger);
       LogEntry logEntry;
-      memcpy(&logEntry, data, dataLen);
-      listOfLogEntries.push_back(logEntry);
+      decodeReturnPayload(returnCode, &logEntry, data, dataLen);
+      if (logEntryCallback) {
+        logEntryCallback(logEntry);
+      } else if (!listOfLogEntries.push_back(logEntry)) {
+        entryDropped();
+      }
       if (debugNukiReadableData) {
         logLogEntry(logEntry, true, logger);
       }
@@ -893,22 +1144,24 @@ void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint
     case Command::InternalLogEntry : {
       printBuffer((byte*)data, dataLen, false, "internalLogEntry", debugNukiHexData, logger);
       InternalLogEntry internalLogEntry;
-      memcpy(&internalLogEntry, data, dataLen);
-      listOfInternalLogEntries.push_back(internalLogEntry);
+      decodeReturnPayload(returnCode, &internalLogEntry, data, dataLen);
+      if (!listOfInternalLogEntries.push_back(internalLogEntry)) {
+        entryDropped();
+      }
       if (debugNukiReadableData) {
         logInternalLogEntry(internalLogEntry, true, logger);
       }
       break;
     }
     case Command::MqttConfig :
-      memcpy(&mqttConfig, data, dataLen);
+      decodeReturnPayload(returnCode, &mqttConfig, data, dataLen);
       if (debugNukiReadableData) {
         logMqttConfig(mqttConfig, true, logger);
       }
       printBuffer((byte*)data, dataLen, false, "mqttConfig", debugNukiHexData, logger);
       break;
     case Command::MqttConfigForMigration : {
-      memcpy(&mqttConfigForMigration, data, dataLen);
+      decodeReturnPayload(returnCode, &mqttConfigForMigration, data, dataLen);
       if (debugNukiReadableData) {
         logMqttConfigForMigration(mqttConfigForMigration, true, logger);
       }
@@ -918,15 +1171,17 @@ void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint
     case Command::WifiScanEntry : {
       printBuffer((byte*)data, dataLen, false, "wifiScanEntry", debugNukiHexData, logger);
       WifiScanEntry wifiScanEntry;
-      memcpy(&wifiScanEntry, data, dataLen);
-      listOfWifiScanEntries.push_back(wifiScanEntry);
+      decodeReturnPayload(returnCode, &wifiScanEntry, data, dataLen);
+      if (!listOfWifiScanEntries.push_back(wifiScanEntry)) {
+        entryDropped();
+      }
       if (debugNukiReadableData) {
         logWifiScanEntry(wifiScanEntry, true, logger);
       }
       break;
     }
     case Command::WifiConfig : {
-      memcpy(&wifiConfig, data, dataLen);
+      decodeReturnPayload(returnCode, &wifiConfig, data, dataLen);
       if (debugNukiReadableData) {
         logWifiConfig(wifiConfig, true, logger);
       }
@@ -934,7 +1189,7 @@ void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint
       break;
     }
     case Command::WifiConfigForMigration : {
-      memcpy(&wifiConfigForMigration, data, dataLen);
+      decodeReturnPayload(returnCode, &wifiConfigForMigration, data, dataLen);
       if (debugNukiReadableData) {
         logWifiConfigForMigration(wifiConfigForMigration, true, logger);
       }
@@ -942,7 +1197,7 @@ void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint
       break;
     }
     case Command::Keypad2Config : {
-      memcpy(&keypad2Config, data, dataLen);
+      decodeReturnPayload(returnCode, &keypad2Config, data, dataLen);
       if (debugNukiReadableData) {
         logKeypad2Config(keypad2Config, true, logger);
       }
@@ -950,7 +1205,7 @@ void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint
       break;
     }
     case Command::GeneralStatistics : {
-      memcpy(&generalStatistics, data, dataLen);
+      decodeReturnPayload(returnCode, &generalStatistics, data, dataLen);
       if (debugNukiReadableData) {
         logGeneralStatistics(generalStatistics, true, logger);
       }
@@ -958,7 +1213,7 @@ void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint
       break;
     }
     case Command::DailyStatistics : {
-      memcpy(&dailyStatistics, data, dataLen);
+      decodeReturnPayload(returnCode, &dailyStatistics, data, dataLen);
       if (debugNukiReadableData) {
         logDailyStatistics(dailyStatistics, true, logger);
       }
@@ -966,7 +1221,7 @@ void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint
       break;
     }
     case Command::AccessoryInfo : {
-      memcpy(&accessoryInfo, data, dataLen);
+      decodeReturnPayload(returnCode, &accessoryInfo, data, dataLen);
       if (debugNukiReadableData) {
         logAccessoryInfo(accessoryInfo, true, logger);
       }
@@ -974,7 +1229,7 @@ void NukiLock::handleReturnMessage(Command returnCode, unsigned char* data, uint
       break;
     }
     case Command::DoorSensorConfig : {
-      memcpy(&doorSensorConfig, data, dataLen);
+      decodeReturnPayload(returnCode, &doorSensorConfig, data, dataLen);
       if (debugNukiReadableData) {
         logDoorSensorConfig(doorSensorConfig, true, logger);
       }
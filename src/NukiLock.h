@@ -6,6 +6,8 @@
 
 namespace NukiLock {
 
+typedef std::function<void(const LogEntry& entry)> LogEntryCallback;
+
 class NukiLock : public Nuki::NukiBle {
   public:
     NukiLock(const std::string& deviceName, const uint32_t deviceId);
@@ -24,6 +26,20 @@ class NukiLock : public Nuki::NukiBle {
     Nuki::CmdResult lockAction(const LockAction lockAction, const uint32_t nukiAppId = 1, const uint8_t flags = 0,
                                const char* nameSuffix = nullptr, const uint8_t nameSuffixLen = 0);
 
+    /**
+     * @brief Sends lock action cmd via BLE to the lock without blocking the calling task
+     *
+     * @param lockAction
+     * @param callback optional, called from the protocol task when the action has been completed
+     * @param nukiAppId 0 = App, 1 = Bridge, 2 = Fob, 3 = Keypad
+     * @param flags optional
+     * @param nameSuffix optional
+     * @param nameSuffixLen len of nameSuffix if used ('\0' included, maximum 19)
+     * @return handle that can be polled or awaited for the result
+     */
+    Nuki::CmdHandle lockActionAsync(const LockAction lockAction, Nuki::CmdCallback callback = nullptr, const uint32_t nukiAppId = 1,
+                                    const uint8_t flags = 0, const char* nameSuffix = nullptr, const uint8_t nameSuffixLen = 0);
+
     /**
      * @brief Send a keypad action entry to the lock via BLE
      * @param source 0x00 = arrow key, 0x01 = code
@@ -39,6 +55,15 @@ class NukiLock : public Nuki::NukiBle {
      */
     Nuki::CmdResult requestKeyTurnerState(KeyTurnerState* retrievedKeyTurnerState);
 
+    /**
+     * @brief Requests keyturner state from Lock via BLE without blocking the calling task,
+     * use retrieveKeyTunerState() to get the state once the command has been completed
+     *
+     * @param callback optional, called from the protocol task when the state has been received
+     * @return handle that can be polled or awaited for the result
+     */
+    Nuki::CmdHandle requestKeyTurnerStateAsync(Nuki::CmdCallback callback = nullptr);
+
     /**
      * @brief Gets the last keyturner state stored on the esp
      *
@@ -54,6 +79,22 @@ class NukiLock : public Nuki::NukiBle {
      */
     Nuki::CmdResult requestBatteryReport(BatteryReport* retrievedBatteryReport);
 
+    /**
+     * @brief Requests battery status from Lock via BLE without blocking the calling task,
+     * use retrieveBatteryReport() to get the status once the command has been completed
+     *
+     * @param callback optional, called from the protocol task when the battery status has been received
+     * @return handle that can be polled or awaited for the result
+     */
+    Nuki::CmdHandle requestBatteryReportAsync(Nuki::CmdCallback callback = nullptr) override;
+
+    /**
+     * @brief Gets the last battery status stored on the esp
+     *
+     * @param retrievedBatteryReport Nuki api based datatype to store the retrieved battery status
+     */
+    void retrieveBatteryReport(BatteryReport* retrievedBatteryReport);
+
 
     /**
      * @brief Requests config from Lock via BLE
@@ -69,6 +110,37 @@ class NukiLock : public Nuki::NukiBle {
      */
     Nuki::CmdResult requestAdvancedConfig(AdvancedConfig* retrievedAdvancedConfig);
 
+    /**
+     * @brief Starts a config transaction: until commitConfigTransaction() the config and advanced config
+     * are read from the Lock only once and the config setters (setName(), ...) only change the read copies
+     */
+    void beginConfigTransaction();
+
+    /**
+     * @brief Sends the config and/or advanced config changed since beginConfigTransaction() to the Lock,
+     * one SetConfig and one SetAdvancedConfig at most, and ends the transaction. When sending fails the
+     * transaction stays open with the changes not sent yet, so it can be committed again or aborted
+     */
+    Nuki::CmdResult commitConfigTransaction();
+
+    /**
+     * @brief Ends the config transaction without sending the changes
+     */
+    void abortConfigTransaction();
+
+    /**
+     * @brief Requests state, battery report, config and advanced config from the Lock over one BLE connection.
+     * Pass nullptr for data that is not needed, data is only copied if the corresponding request succeeded.
+     *
+     * @param retrievedKeyTurnerState Nuki api based datatype to store the retrieved state
+     * @param retrievedBatteryReport Nuki api based datatype to store the retrieved battery status
+     * @param retrievedConfig Nuki api based datatype to store the retrieved config
+     * @param retrievedAdvancedConfig Nuki api based datatype to store the retrieved advanced config
+     * @return Nuki::CmdResult::Success if all requests succeeded, else the result of the first failing request
+     */
+    Nuki::CmdResult requestStatus(KeyTurnerState* retrievedKeyTurnerState, BatteryReport* retrievedBatteryReport,
+                                  Config* retrievedConfig, AdvancedConfig* retrievedAdvancedConfig);
+
     /**
      * @brief Request the lock via BLE to send the internal log entries
      *
@@ -86,6 +158,11 @@ class NukiLock : public Nuki::NukiBle {
      */
     void getInternalLogEntries(std::list<InternalLogEntry>* requestedInternalLogEntries);
 
+    /**
+     * @brief Returns the Internal Log Entries stored on the esp without copying them, valid until the next retrieval
+     */
+    const Nuki::EntryBuffer<InternalLogEntry>& getInternalLogEntries() const;
+
     /**
      * @brief Gets the current config from the lock, updates the name parameter and sends the
      * new config to the lock via BLE
@@ -440,6 +517,11 @@ class NukiLock : public Nuki::NukiBle {
      */
     void getTimeControlEntries(std::list<TimeControlEntry>* timeControlEntries);
 
+    /**
+     * @brief Returns the time control entries stored on the esp without copying them, valid until the next retrieval
+     */
+    const Nuki::EntryBuffer<TimeControlEntry>& getTimeControlEntries() const;
+
     /**
      * @brief Get the Log Entries stored on the esp. Only available after executing retreiveLogEntries.
      *
@@ -447,6 +529,11 @@ class NukiLock : public Nuki::NukiBle {
      */
     void getLogEntries(std::list<LogEntry>* requestedLogEntries);
 
+    /**
+     * @brief Returns the Log Entries stored on the esp without copying them, valid until the next retrieval
+     */
+    const Nuki::EntryBuffer<LogEntry>& getLogEntries() const;
+
     /**
      * @brief Request the lock via BLE to send the log entries
      *
@@ -454,9 +541,22 @@ class NukiLock : public Nuki::NukiBle {
      * @param count The number of log entries to be read, starting at the specified start index.
      * @param sortOrder The desired sort order
      * @param totalCount true if a Log Entry Count is requested from the lock
+     * @param callback optional, called on the protocol task for every log entry as it is received instead
+     * of storing the entries for getLogEntries(). Stays installed until the next retrieval.
      */
     Nuki::CmdResult retrieveLogEntries(const uint32_t startIndex, const uint16_t count, const uint8_t sortOrder,
-                                       const bool totalCount);
+                                       const bool totalCount, LogEntryCallback callback = nullptr);
+
+    /**
+     * @brief Synchronizes the log entries added since the previous sync. The index of the newest entry
+     * is persisted, so only new entries are requested (also after a restart), in pages of pageSize
+     * entries. Gaps in the index sequence and a restarted log on the lock are reported by getLogSyncStats().
+     * A sync stops after LOG_SYNC_MAX_PAGES pages or a full page without new entries, call again to continue.
+     *
+     * @param callback called on the protocol task for every new log entry, oldest first
+     * @param pageSize number of entries requested at once
+     */
+    Nuki::CmdResult syncLogEntries(LogEntryCallback callback, const uint16_t pageSize = LOG_SYNC_PAGE_SIZE);
 
     /**
      * @brief Retrieve information about an accessory
@@ -479,6 +579,11 @@ class NukiLock : public Nuki::NukiBle {
      */
     void getWifiScanEntries(std::list<WifiScanEntry>* wifiScanEntries);
 
+    /**
+     * @brief Returns the Wifi scan entries stored on the esp without copying them, valid until the next retrieval
+     */
+    const Nuki::EntryBuffer<WifiScanEntry>& getWifiScanEntries() const;
+
     /**
      * @brief Returns battery critical state parsed from the battery state byte (battery critical byte)
      *
@@ -533,9 +638,14 @@ class NukiLock : public Nuki::NukiBle {
 
   protected:
     void handleReturnMessage(Command returnCode, unsigned char* data, uint16_t dataLen) override;
+    const Nuki::PayloadSize* findExpectedPayloadSize(const Command returnCode) const override;
+    Nuki::CmdHandle requestStateAsync(Nuki::CmdCallback callback) override;
+    Nuki::CmdResult requestLogPage(const uint32_t startIndex, const uint16_t count, const uint8_t sortOrder) override;
 
 
   private:
+    void createLockAction(Action* action, const LockAction lockAction, const uint32_t nukiAppId, const uint8_t flags,
+                          const char* nameSuffix, const uint8_t nameSuffixLen);
     Nuki::CmdResult setConfig(NewConfig newConfig);
     Nuki::CmdResult setFromConfig(const Config config);
     Nuki::CmdResult setAdvancedConfig(NewAdvancedConfig newAdvancedConfig);
@@ -545,13 +655,16 @@ class NukiLock : public Nuki::NukiBle {
 
     KeyTurnerState keyTurnerState;
     BatteryReport batteryReport;
-    std::list<TimeControlEntry> listOfTimeControlEntries;
-    std::list<LogEntry> listOfLogEntries;
-    std::list<InternalLogEntry> listOfInternalLogEntries;
-    std::list<WifiScanEntry> listOfWifiScanEntries;
+    EntryBuffer<TimeControlEntry> listOfTimeControlEntries;
+    EntryBuffer<LogEntry> listOfLogEntries;
+    LogEntryCallback logEntryCallback = nullptr;
+    LogEntryCallback logSyncCallback = nullptr;
+    EntryBuffer<InternalLogEntry> listOfInternalLogEntries;
+    EntryBuffer<WifiScanEntry> listOfWifiScanEntries;
 
     Config config;
     AdvancedConfig advancedConfig;
+    Nuki::ConfigTransaction<Config, AdvancedConfig> configTransaction;
     MqttConfig mqttConfig;
     MqttConfigForMigration mqttConfigForMigration;
     WifiConfig wifiConfig;
@@ -33,6 +33,12 @@ void cmdResultToString(const CmdResult state, char* str) {
     case CmdResult::NotPaired:
       strcpy(str, "notPaired");
       break;
+    case CmdResult::Lock_Busy:
+      strcpy(str, "lockBusy");
+      break;
+    case CmdResult::Busy:
+      strcpy(str, "busy");
+      break;
     case CmdResult::Error:
       strcpy(str, "error");
       break;
@@ -0,0 +1,63 @@
+/**
+ * @file NukiNonceProvider.cpp
+ *
+ * Created: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ */
+
+#include "NukiNonceProvider.h"
+#include "esp_random.h"
+
+namespace Nuki {
+
+void HardwareNonceProvider::fill(uint8_t* nonce, const size_t len) {
+  uint32_t tail = poolTail.load(std::memory_order_relaxed);
+  uint32_t head = poolHead.load(std::memory_order_acquire);
+
+  if (head - tail < len) {
+    poolMisses.fetch_add(1, std::memory_order_relaxed);
+    esp_fill_random(nonce, len);
+    return;
+  }
+
+  copyFromPool(nonce, tail, len);
+  poolTail.store(tail + len, std::memory_order_release);
+}
+
+void HardwareNonceProvider::refill() {
+  uint32_t head = poolHead.load(std::memory_order_relaxed);
+  uint32_t tail = poolTail.load(std::memory_order_acquire);
+  size_t freeLen = NUKI_NONCE_POOL_SIZE - (head - tail);
+
+  if (freeLen == 0) {
+    return;
+  }
+
+  //the free part of the pool wraps at most once
+  size_t start = head % NUKI_NONCE_POOL_SIZE;
+  size_t firstLen = freeLen < NUKI_NONCE_POOL_SIZE - start ? freeLen : NUKI_NONCE_POOL_SIZE - start;
+  esp_fill_random(&pool[start], firstLen);
+  if (freeLen > firstLen) {
+    esp_fill_random(&pool[0], freeLen - firstLen);
+  }
+  poolHead.store(head + freeLen, std::memory_order_release);
+}
+
+size_t HardwareNonceProvider::getAvailable() const {
+  return poolHead.load(std::memory_order_acquire) - poolTail.load(std::memory_order_acquire);
+}
+
+uint32_t HardwareNonceProvider::getPoolMisses() const {
+  return poolMisses.load(std::memory_order_relaxed);
+}
+
+void HardwareNonceProvider::copyFromPool(uint8_t* target, const uint32_t from, const size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    uint8_t* poolByte = &pool[(from + i) % NUKI_NONCE_POOL_SIZE];
+    target[i] = *poolByte;
+    *poolByte = 0;
+  }
+}
+
+} // namespace Nuki
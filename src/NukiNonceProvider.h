@@ -0,0 +1,110 @@
+#pragma once
+
+/**
+ * @file NukiNonceProvider.h
+ * Sources of the random nonces used for encrypting messages to the lock
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * HardwareNonceProvider hands out bytes from a pool filled by the hardware RNG (esp_fill_random).
+ * The pool is topped up by the protocol task of the lock, which is notified after every nonce taken,
+ * so the send path only copies bytes. Sends to a lock are serialized and each send is followed by a
+ * refill, so the pool (at least two nonces) does not run dry, extras/nonce_test verifies this. Bytes
+ * are handed out once and wiped from the pool, when the pool runs dry the RNG is read directly.
+ * The hardware RNG only delivers true random numbers while the radio is enabled, which is the case
+ * as long as BLE is initialized.
+ * DeterministicNonceProvider only depends on the C library and generates a reproducible sequence of
+ * unique nonces from a seed, for host side tests. Never use it with a real lock.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+#ifndef NUKI_NONCE_POOL_SIZE
+#define NUKI_NONCE_POOL_SIZE 256
+#endif
+
+namespace Nuki {
+
+class NonceProvider {
+  public:
+    virtual ~NonceProvider() = default;
+
+    /**
+     * @brief Fills nonce with len random bytes, bytes are never handed out twice
+     */
+    virtual void fill(uint8_t* nonce, const size_t len) = 0;
+
+    /**
+     * @brief Tops up pre-generated bytes, called from the protocol task
+     */
+    virtual void refill() {}
+};
+
+class HardwareNonceProvider : public NonceProvider {
+  public:
+    static_assert((NUKI_NONCE_POOL_SIZE & (NUKI_NONCE_POOL_SIZE - 1)) == 0, "NUKI_NONCE_POOL_SIZE must be a power of 2");
+    static_assert(NUKI_NONCE_POOL_SIZE >= 64, "NUKI_NONCE_POOL_SIZE must hold at least two nonces");
+
+    /**
+     * @brief Takes len bytes from the pool, reads the RNG directly if the pool holds less than len bytes.
+     * Only one task may call fill() at a time (the task executing the command).
+     */
+    void fill(uint8_t* nonce, const size_t len) override;
+
+    /**
+     * @brief Fills the free part of the pool from the RNG, only one task may call refill() at a time
+     */
+    void refill() override;
+
+    /**
+     * @brief Returns the number of bytes available in the pool
+     */
+    size_t getAvailable() const;
+
+    /**
+     * @brief Returns the number of fill() calls that could not be served from the pool
+     */
+    uint32_t getPoolMisses() const;
+
+  private:
+    void copyFromPool(uint8_t* target, const uint32_t from, const size_t len);
+
+    uint8_t pool[NUKI_NONCE_POOL_SIZE] = {};
+    std::atomic<uint32_t> poolHead{0};
+    std::atomic<uint32_t> poolTail{0};
+    std::atomic<uint32_t> poolMisses{0};
+};
+
+class DeterministicNonceProvider : public NonceProvider {
+  public:
+    explicit DeterministicNonceProvider(const uint64_t seed = 0) : counter(seed) {}
+
+    /**
+     * @brief Fills nonce with the next bytes of the splitmix64 sequence of the seed. Every call starts
+     * at a new 8 byte block so nonces never share bytes.
+     */
+    void fill(uint8_t* nonce, const size_t len) override {
+      for (size_t i = 0; i < len; i += sizeof(uint64_t)) {
+        uint64_t block = next();
+        size_t blockLen = len - i < sizeof(uint64_t) ? len - i : sizeof(uint64_t);
+        memcpy(&nonce[i], &block, blockLen);
+      }
+    }
+
+  private:
+    uint64_t next() {
+      uint64_t z = (counter += 0x9e3779b97f4a7c15ULL);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      return z ^ (z >> 31);
+    }
+
+    uint64_t counter;
+};
+
+} // namespace Nuki
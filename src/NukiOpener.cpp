@@ -3,6 +3,17 @@
 #include "NukiOpenerUtils.h"
 
 namespace NukiOpener {
+
+//payloads decoded into a data type by decodeReturnPayload()
+static constexpr Nuki::PayloadSize payloadSizes[] = {
+  Nuki::payloadSizeFrom<OpenerState>((uint16_t)Command::KeyturnerStates, offsetof(OpenerState, configUpdateCount)),
+  Nuki::payloadSizeOf<BatteryReport>((uint16_t)Command::BatteryReport),
+  Nuki::payloadSizeFrom<Config>((uint16_t)Command::Config, offsetof(Config, hasKeypadV2)),
+  Nuki::payloadSizeFrom<AdvancedConfig>((uint16_t)Command::AdvancedConfig, offsetof(AdvancedConfig, autoUpdateEnabled)),
+  Nuki::payloadSizeOf<TimeControlEntry>((uint16_t)Command::TimeControlEntry),
+  Nuki::payloadSizeFrom<LogEntry>((uint16_t)Command::LogEntry, offsetof(LogEntry, data))
+};
+
 NukiOpener::NukiOpener(const std::string& deviceName, const uint32_t deviceId)
   : NukiBle(deviceName,
             deviceId,
@@ -18,7 +29,19 @@ NukiOpener::NukiOpener(const std::string& deviceName, const uint32_t deviceId)
 
 Nuki::CmdResult NukiOpener::lockAction(const LockAction lockAction, const uint32_t nukiAppId, const uint8_t flags, const char* nameSuffix, const uint8_t nameSuffixLen) {
   Action action;
-  
+  createLockAction(&action, lockAction, nukiAppId, flags, nameSuffix, nameSuffixLen);
+  return executeAction(action);
+}
+
+Nuki::CmdHandle NukiOpener::lockActionAsync(const LockAction lockAction, Nuki::CmdCallback callback, const uint32_t nukiAppId, const uint8_t flags,
+    const char* nameSuffix, const uint8_t nameSuffixLen) {
+  Action action;
+  createLockAction(&action, lockAction, nukiAppId, flags, nameSuffix, nameSuffixLen);
+  return submit(action, callback);
+}
+
+void NukiOpener::createLockAction(Action* action, const LockAction lockAction, const uint32_t nukiAppId, const uint8_t flags,
+                                  const char* nameSuffix, const uint8_t nameSuffixLen) {
   if((lockAction == LockAction::ActivateCM || lockAction == LockAction::DeactivateCM) && nukiAppId != 1)
   {
       ContinuousModeAction continuousModeAction;
@@ -26,12 +49,10 @@ Nuki::CmdResult NukiOpener::lockAction(const LockAction lockAction, const uint32
       unsigned char payload[sizeof(ContinuousModeAction)] = {0};
       memcpy(payload, &continuousModeAction, sizeof(ContinuousModeAction));
 
-      action.cmdType = Nuki::CommandType::CommandWithChallengeAndPin;
-      action.command = Command::ContinuousModeAction;
-      memcpy(action.payload, &payload, sizeof(ContinuousModeAction));
-      action.payloadLen = sizeof(ContinuousModeAction);
-
-      return executeAction(action);    
+      action->cmdType = Nuki::CommandType::CommandWithChallengeAndPin;
+      action->command = Command::ContinuousModeAction;
+      memcpy(action->payload, &payload, sizeof(ContinuousModeAction));
+      action->payloadLen = sizeof(ContinuousModeAction);
   }
   else
   {
@@ -47,12 +68,10 @@ Nuki::CmdResult NukiOpener::lockAction(const LockAction lockAction, const uint32
         payloadLen = sizeof(LockAction) + 4 + 1;
       }
 
-      action.cmdType = Nuki::CommandType::CommandWithChallengeAndAccept;
-      action.command = Command::LockAction;
-      memcpy(action.payload, &payload, payloadLen);
-      action.payloadLen = payloadLen;
-
-      return executeAction(action);
+      action->cmdType = Nuki::CommandType::CommandWithChallengeAndAccept;
+      action->command = Command::LockAction;
+      memcpy(action->payload, &payload, payloadLen);
+      action->payloadLen = payloadLen;
   }
 }
 
@@ -75,6 +94,19 @@ Nuki::CmdResult NukiOpener::requestOpenerState(OpenerState* state) {
   return result;
 }
 
+Nuki::CmdHandle NukiOpener::requestOpenerStateAsync(Nuki::CmdCallback callback) {
+  Action action;
+  uint16_t payload = (uint16_t)Command::KeyturnerStates;
+
+  memset(&action, 0, sizeof(action));
+  action.cmdType = Nuki::CommandType::Command;
+  action.command = Command::RequestData;
+  memcpy(&action.payload[0], &payload, sizeof(payload));
+  action.payloadLen = sizeof(payload);
+
+  return submit(action, callback);
+}
+
 void NukiOpener::retrieveOpenerState(OpenerState* state) {
   memcpy(state, &openerState, sizeof(OpenerState));
 }
@@ -97,8 +129,42 @@ Nuki::CmdResult NukiOpener::requestBatteryReport(BatteryReport* retrievedBattery
   return result;
 }
 
+Nuki::CmdHandle NukiOpener::requestBatteryReportAsync(Nuki::CmdCallback callback) {
+  Action action;
+  uint16_t payload = (uint16_t)Command::BatteryReport;
+
+  memset(&action, 0, sizeof(action));
+  action.cmdType = Nuki::CommandType::Command;
+  action.command = Command::RequestData;
+  memcpy(&action.payload[0], &payload, sizeof(payload));
+  action.payloadLen = sizeof(payload);
+
+  return submit(action, callback);
+}
+
+void NukiOpener::retrieveBatteryReport(BatteryReport* retrievedBatteryReport) {
+  memcpy(retrievedBatteryReport, &batteryReport, sizeof(BatteryReport));
+}
+
+Nuki::CmdHandle NukiOpener::requestStateAsync(Nuki::CmdCallback callback) {
+  return requestOpenerStateAsync(callback);
+}
+
 
 Nuki::CmdResult NukiOpener::requestConfig(Config* retrievedConfig) {
+  if (configTransaction.active && configTransaction.configRead) {
+    memcpy(retrievedConfig, &configTransaction.config, sizeof(Config));
+    return Nuki::CmdResult::Success;
+  }
+  if (configCacheEnabled && configCacheValid) {
+    memcpy(retrievedConfig, &config, sizeof(Config));
+    if (configTransaction.active) {
+      memcpy(&configTransaction.config, &config, sizeof(Config));
+      configTransaction.configRead = true;
+    }
+    return Nuki::CmdResult::Success;
+  }
+
   Action action;
 
   memset(&action, 0, sizeof(action));
@@ -108,11 +174,28 @@ Nuki::CmdResult NukiOpener::requestConfig(Config* retrievedConfig) {
   Nuki::CmdResult result = executeAction(action);
   if (result == Nuki::CmdResult::Success) {
     memcpy(retrievedConfig, &config, sizeof(Config));
+    if (configTransaction.active) {
+      memcpy(&configTransaction.config, &config, sizeof(Config));
+      configTransaction.configRead = true;
+    }
   }
   return result;
 }
 
 Nuki::CmdResult NukiOpener::requestAdvancedConfig(AdvancedConfig* retrievedAdvancedConfig) {
+  if (configTransaction.active && configTransaction.advancedConfigRead) {
+    memcpy(retrievedAdvancedConfig, &configTransaction.advancedConfig, sizeof(AdvancedConfig));
+    return Nuki::CmdResult::Success;
+  }
+  if (configCacheEnabled && advancedConfigCacheValid) {
+    memcpy(retrievedAdvancedConfig, &advancedConfig, sizeof(AdvancedConfig));
+    if (configTransaction.active) {
+      memcpy(&configTransaction.advancedConfig, &advancedConfig, sizeof(AdvancedConfig));
+      configTransaction.advancedConfigRead = true;
+    }
+    return Nuki::CmdResult::Success;
+  }
+
   Action action;
 
   memset(&action, 0, sizeof(action));
@@ -122,6 +205,98 @@ Nuki::CmdResult NukiOpener::requestAdvancedConfig(AdvancedConfig* retrievedAdvan
   Nuki::CmdResult result = executeAction(action);
   if (result == Nuki::CmdResult::Success) {
     memcpy(retrievedAdvancedConfig, &advancedConfig, sizeof(AdvancedConfig));
+    if (configTransaction.active) {
+      memcpy(&configTransaction.advancedConfig, &advancedConfig, sizeof(AdvancedConfig));
+      configTransaction.advancedConfigRead = true;
+    }
+  }
+  return result;
+}
+
+void NukiOpener::beginConfigTransaction() {
+  configTransaction.active = true;
+  configTransaction.configRead = false;
+  configTransaction.configChanged = false;
+  configTransaction.advancedConfigRead = false;
+  configTransaction.advancedConfigChanged = false;
+}
+
+Nuki::CmdResult NukiOpener::commitConfigTransaction() {
+  Nuki::CmdResult result = Nuki::CmdResult::Success;
+  configTransaction.active = false;
+
+  if (configTransaction.configChanged) {
+    result = setFromConfig(configTransaction.config);
+    if (result == Nuki::CmdResult::Success) {
+      configTransaction.configChanged = false;
+    }
+  }
+  if (result == Nuki::CmdResult::Success && configTransaction.advancedConfigChanged) {
+    result = setFromAdvancedConfig(configTransaction.advancedConfig);
+    if (result == Nuki::CmdResult::Success) {
+      configTransaction.advancedConfigChanged = false;
+    }
+  }
+  //the changes not sent are kept, the transaction stays open to commit again or abort
+  configTransaction.active = result != Nuki::CmdResult::Success;
+  return result;
+}
+
+void NukiOpener::abortConfigTransaction() {
+  configTransaction.active = false;
+  configTransaction.configChanged = false;
+  configTransaction.advancedConfigChanged = false;
+}
+
+Nuki::CmdResult NukiOpener::requestStatus(OpenerState* retrievedOpenerState, BatteryReport* retrievedBatteryReport,
+                                      Config* retrievedConfig, AdvancedConfig* retrievedAdvancedConfig) {
+  Action actions[4];
+  Nuki::CmdResult results[4];
+  uint8_t count = 0;
+  uint16_t payload = 0;
+
+  memset(actions, 0, sizeof(actions));
+  if (retrievedOpenerState) {
+    payload = (uint16_t)Command::KeyturnerStates;
+    actions[count].cmdType = Nuki::CommandType::Command;
+    actions[count].command = Command::RequestData;
+    memcpy(&actions[count].payload[0], &payload, sizeof(payload));
+    actions[count].payloadLen = sizeof(payload);
+    count++;
+  }
+  if (retrievedBatteryReport) {
+    payload = (uint16_t)Command::BatteryReport;
+    actions[count].cmdType = Nuki::CommandType::Command;
+    actions[count].command = Command::RequestData;
+    memcpy(&actions[count].payload[0], &payload, sizeof(payload));
+    actions[count].payloadLen = sizeof(payload);
+    count++;
+  }
+  if (retrievedConfig) {
+    actions[count].cmdType = Nuki::CommandType::CommandWithChallenge;
+    actions[count].command = Command::RequestConfig;
+    count++;
+  }
+  if (retrievedAdvancedConfig) {
+    actions[count].cmdType = Nuki::CommandType::CommandWithChallenge;
+    actions[count].command = Command::RequestAdvancedConfig;
+    count++;
+  }
+
+  Nuki::CmdResult result = executeBatch(actions, count, results);
+
+  uint8_t i = 0;
+  if (retrievedOpenerState && results[i++] == Nuki::CmdResult::Success) {
+    memcpy(retrievedOpenerState, &openerState, sizeof(OpenerState));
+  }
+  if (retrievedBatteryReport && results[i++] == Nuki::CmdResult::Success) {
+    memcpy(retrievedBatteryReport, &batteryReport, sizeof(BatteryReport));
+  }
+  if (retrievedConfig && results[i++] == Nuki::CmdResult::Success) {
+    memcpy(retrievedConfig, &config, sizeof(Config));
+  }
+  if (retrievedAdvancedConfig && results[i++] == Nuki::CmdResult::Success) {
+    memcpy(retrievedAdvancedConfig, &advancedConfig, sizeof(AdvancedConfig));
   }
   return result;
 }
@@ -544,13 +719,17 @@ Nuki::CmdResult NukiOpener::retrieveTimeControlEntries() {
 
 void NukiOpener::getTimeControlEntries(std::list<TimeControlEntry>* requestedTimeControlEntries) {
   requestedTimeControlEntries->clear();
-  std::list<TimeControlEntry>::iterator it = listOfTimeControlEntries.begin();
+  auto it = listOfTimeControlEntries.begin();
   while (it != listOfTimeControlEntries.end()) {
     requestedTimeControlEntries->push_back(*it);
     it++;
   }
 }
 
+const Nuki::EntryBuffer<TimeControlEntry>& NukiOpener::getTimeControlEntries() const {
+  return listOfTimeControlEntries;
+}
+
 void NukiOpener::getLogEntries(std::list<LogEntry>* requestedLogEntries) {
   requestedLogEntries->clear();
 
@@ -559,7 +738,12 @@ void NukiOpener::getLogEntries(std::list<LogEntry>* requestedLogEntries) {
   }
 }
 
-Nuki::CmdResult NukiOpener::retrieveLogEntries(const uint32_t startIndex, const uint16_t count, const uint8_t sortOrder, bool const totalCount) {
+const Nuki::EntryBuffer<LogEntry>& NukiOpener::getLogEntries() const {
+  return listOfLogEntries;
+}
+
+Nuki::CmdResult NukiOpener::retrieveLogEntries(const uint32_t startIndex, const uint16_t count, const uint8_t sortOrder, bool const totalCount,
+    LogEntryCallback callback) {
   Action action;
   unsigned char payload[8] = {0};
   memcpy(payload, &startIndex, 4);
@@ -573,10 +757,24 @@ Nuki::CmdResult NukiOpener::retrieveLogEntries(const uint32_t startIndex, const
   action.payloadLen = sizeof(payload);
 
   listOfLogEntries.clear();
+  logEntryCallback = callback;
 
   return executeAction(action);
 }
 
+Nuki::CmdResult NukiOpener::syncLogEntries(LogEntryCallback callback, const uint16_t pageSize) {
+  logSyncCallback = callback;
+  return syncLog(pageSize);
+}
+
+Nuki::CmdResult NukiOpener::requestLogPage(const uint32_t startIndex, const uint16_t count, const uint8_t sortOrder) {
+  return retrieveLogEntries(startIndex, count, sortOrder, false, [this](const LogEntry& logEntry) {
+    if (acceptLogEntry(logEntry.index) && logSyncCallback) {
+      logSyncCallback(logEntry);
+    }
+  });
+}
+
 bool NukiOpener::isBatteryCritical() {
   return openerState.criticalBatteryState & 1;
 }
@@ -591,7 +789,7 @@ bool NukiOpener::isKeypadBatteryCritical() {
 }
 
 const ErrorCode NukiOpener::getLastError() const {
-  return (ErrorCode)errorCode;
+  return (ErrorCode)errorCode.load();
 }
 
 Nuki::CmdResult NukiOpener::setConfig(NewConfig newConfig) {
@@ -604,16 +802,32 @@ Nuki::CmdResult NukiOpener::setConfig(NewConfig newConfig) {
   memcpy(action.payload, &payload, sizeof(payload));
   action.payloadLen = sizeof(payload);
 
+  //the lock changes the config update count, read the config again on the next request
+  configCacheValid = false;
   return executeAction(action);
 }
 
 Nuki::CmdResult NukiOpener::setFromConfig(const Config config) {
+  if (configTransaction.active) {
+    memcpy(&configTransaction.config, &config, sizeof(Config));
+    configTransaction.configRead = true;
+    configTransaction.configChanged = true;
+    return Nuki::CmdResult::Success;
+  }
+
   NewConfig newConfig;
   createNewConfig(&config, &newConfig);
   return setConfig(newConfig);
 }
 
 Nuki::CmdResult NukiOpener::setFromAdvancedConfig(const AdvancedConfig config) {
+  if (configTransaction.active) {
+    memcpy(&configTransaction.advancedConfig, &config, sizeof(AdvancedConfig));
+    configTransaction.advancedConfigRead = true;
+    configTransaction.advancedConfigChanged = true;
+    return Nuki::CmdResult::Success;
+  }
+
   NewAdvancedConfig newConfig;
   createNewAdvancedConfig(&config, &newConfig);
   return setAdvancedConfig(newConfig);
@@ -629,6 +843,7 @@ Nuki::CmdResult NukiOpener::setAdvancedConfig(NewAdvancedConfig newAdvancedConfi
   memcpy(action.payload, &payload, sizeof(payload));
   action.payloadLen = sizeof(payload);
 
+  advancedConfigCacheValid = false;
   return executeAction(action);
 }
 
@@ -674,13 +889,19 @@ void NukiOpener::createNewAdvancedConfig(const AdvancedConfig* oldConfig, NewAdv
 }
 
 
+const Nuki::PayloadSize* NukiOpener::findExpectedPayloadSize(const Command returnCode) const {
+  const Nuki::PayloadSize* expected = Nuki::findPayloadSize(payloadSizes, sizeof(payloadSizes) / sizeof(payloadSizes[0]), (uint16_t)returnCode);
+  return expected != nullptr ? expected : NukiBle::findExpectedPayloadSize(returnCode);
+}
+
 void NukiOpener::handleReturnMessage(Command returnCode, unsigned char* data, uint16_t dataLen) {
   extendDisconnectTimeout();
 
   switch (returnCode) {
     case Command::KeyturnerStates : {
       printBuffer((byte*)data, dataLen, false, "keyturnerStates", debugNukiHexData, logger);
-      memcpy(&openerState, data, dataLen);
+      decodeReturnPayload(returnCode, &openerState, data, dataLen);
+      checkConfigUpdateCount(openerState.configUpdateCount);
       if (debugNukiReadableData) {
         logKeyturnerState(openerState, true, logger);
       }
@@ -688,14 +909,16 @@ void NukiOpener::handleReturnMessage(Command returnCode, unsigned char* data, ui
     }
     case Command::BatteryReport : {
       printBuffer((byte*)data, dataLen, false, "batteryReport", debugNukiHexData, logger);
-      memcpy(&batteryReport, data, dataLen);
+      decodeReturnPayload(returnCode, &batteryReport, data, dataLen);
       if (debugNukiReadableData) {
         logBatteryReport(batteryReport, true, logger);
       }
       break;
     }
     case Command::Config : {
-      memcpy(&config, data, dataLen);
+      decodeReturnPayload(returnCode, &config, data, dataLen);
+      configCacheValid = true;
+      updateGattCacheFirmwareVersion(config.firmwareVersion);
       if (debugNukiReadableData) {
         logConfig(config, true, logger);
       }
@@ -703,7 +926,8 @@ void NukiOpener::handleReturnMessage(Command returnCode, unsigned char* data, ui
       break;
     }
     case Command::AdvancedConfig : {
-      memcpy(&advancedConfig, data, dataLen);
+      decodeReturnPayload(returnCode, &advancedConfig, data, dataLen);
+      advancedConfigCacheValid = true;
       if (debugNukiReadableData) {
         logAdvancedConfig(advancedConfig, true, logger);
       }
@@ -713,15 +937,21 @@ void NukiOpener::handleReturnMessage(Command returnCode, unsigned char* data, ui
     case Command::TimeControlEntry : {
       printBuffer((byte*)data, dataLen, false, "timeControlEntry", debugNukiHexData, logger);
       TimeControlEntry timeControlEntry;
-      memcpy(&timeControlEntry, data, dataLen);
-      listOfTimeControlEntries.push_back(timeControlEntry);
+      decodeReturnPayload(returnCode, &timeControlEntry, data, dataLen);
+      if (!listOfTimeControlEntries.push_back(timeControlEntry)) {
+        entryDropped();
+      }
       break;
     }
     case Command::LogEntry : {
       printBuffer((byte*)data, dataLen, false, "logEntry", debugNukiHexData, logger);
       LogEntry logEntry;
-      memcpy(&logEntry, data, dataLen);
-      listOfLogEntries.push_back(logEntry);
+      decodeReturnPayload(returnCode, &logEntry, data, dataLen);
+      if (logEntryCallback) {
+        logEntryCallback(logEntry);
+      } else if (!listOfLogEntries.push_back(logEntry)) {
+        entryDropped();
+      }
       if (debugNukiReadableData) {
         logLogEntry(logEntry, true, logger);
       }
@@ -5,6 +5,8 @@
 
 namespace NukiOpener {
 
+typedef std::function<void(const LogEntry& entry)> LogEntryCallback;
+
 class NukiOpener : public Nuki::NukiBle {
   public:
     NukiOpener(const std::string& deviceName, const uint32_t deviceId);
@@ -22,6 +24,20 @@ class NukiOpener : public Nuki::NukiBle {
     Nuki::CmdResult lockAction(const LockAction lockAction, const uint32_t nukiAppId = 1, const uint8_t flags = 0,
                                const char* nameSuffix = nullptr, const uint8_t nameSuffixLen = 0);
 
+    /**
+     * @brief Sends lock action cmd via BLE to the opener without blocking the calling task
+     *
+     * @param lockAction
+     * @param callback optional, called from the protocol task when the action has been completed
+     * @param nukiAppId 0 = App, 1 = Bridge, 2 = Fob, 3 = Keypad
+     * @param flags optional
+     * @param nameSuffix optional
+     * @param nameSuffixLen len of nameSuffix if used
+     * @return handle that can be polled or awaited for the result
+     */
+    Nuki::CmdHandle lockActionAsync(const LockAction lockAction, Nuki::CmdCallback callback = nullptr, const uint32_t nukiAppId = 1,
+                                    const uint8_t flags = 0, const char* nameSuffix = nullptr, const uint8_t nameSuffixLen = 0);
+
 
     /**
      * @brief Requests keyturner state from Opener via BLE
@@ -30,6 +46,15 @@ class NukiOpener : public Nuki::NukiBle {
      */
     Nuki::CmdResult requestOpenerState(OpenerState* state);
 
+    /**
+     * @brief Requests keyturner state from Opener via BLE without blocking the calling task,
+     * use retrieveOpenerState() to get the state once the command has been completed
+     *
+     * @param callback optional, called from the protocol task when the state has been received
+     * @return handle that can be polled or awaited for the result
+     */
+    Nuki::CmdHandle requestOpenerStateAsync(Nuki::CmdCallback callback = nullptr);
+
     /**
      * @brief Gets the last keyturner state stored on the esp
      *
@@ -45,6 +70,22 @@ class NukiOpener : public Nuki::NukiBle {
      */
     Nuki::CmdResult requestBatteryReport(BatteryReport* retrievedBatteryReport);
 
+    /**
+     * @brief Requests battery status from Opener via BLE without blocking the calling task,
+     * use retrieveBatteryReport() to get the status once the command has been completed
+     *
+     * @param callback optional, called from the protocol task when the battery status has been received
+     * @return handle that can be polled or awaited for the result
+     */
+    Nuki::CmdHandle requestBatteryReportAsync(Nuki::CmdCallback callback = nullptr) override;
+
+    /**
+     * @brief Gets the last battery status stored on the esp
+     *
+     * @param retrievedBatteryReport Nuki api based datatype to store the retrieved battery status
+     */
+    void retrieveBatteryReport(BatteryReport* retrievedBatteryReport);
+
 
     /**
      * @brief Gets the current config from the opener, updates the name parameter and sends the
@@ -345,6 +386,11 @@ class NukiOpener : public Nuki::NukiBle {
      */
     void getTimeControlEntries(std::list<TimeControlEntry>* timeControlEntries);
 
+    /**
+     * @brief Returns the time control entries stored on the esp without copying them, valid until the next retrieval
+     */
+    const Nuki::EntryBuffer<TimeControlEntry>& getTimeControlEntries() const;
+
     /**
      * @brief Get the Log Entries stored on the esp. Only available after executing retreiveLogEntries.
      *
@@ -352,6 +398,11 @@ class NukiOpener : public Nuki::NukiBle {
      */
     void getLogEntries(std::list<LogEntry>* requestedLogEntries);
 
+    /**
+     * @brief Returns the Log Entries stored on the esp without copying them, valid until the next retrieval
+     */
+    const Nuki::EntryBuffer<LogEntry>& getLogEntries() const;
+
     /**
     * @brief Request the opener via BLE to send the log entries
     *
@@ -359,9 +410,22 @@ class NukiOpener : public Nuki::NukiBle {
     * @param count The number of log entries to be read, starting at the specified start index.
     * @param sortOrder The desired sort order
     * @param totalCount true if a Log Entry Count is requested from the opener
+    * @param callback optional, called on the protocol task for every log entry as it is received instead
+    * of storing the entries for getLogEntries(). Stays installed until the next retrieval.
     */
     Nuki::CmdResult retrieveLogEntries(const uint32_t startIndex, const uint16_t count, const uint8_t sortOrder,
-                                       const bool totalCount);
+                                       const bool totalCount, LogEntryCallback callback = nullptr);
+
+    /**
+     * @brief Synchronizes the log entries added since the previous sync. The index of the newest entry
+     * is persisted, so only new entries are requested (also after a restart), in pages of pageSize
+     * entries. Gaps in the index sequence and a restarted log on the opener are reported by getLogSyncStats().
+     * A sync stops after LOG_SYNC_MAX_PAGES pages or a full page without new entries, call again to continue.
+     *
+     * @param callback called on the protocol task for every new log entry, oldest first
+     * @param pageSize number of entries requested at once
+     */
+    Nuki::CmdResult syncLogEntries(LogEntryCallback callback, const uint16_t pageSize = LOG_SYNC_PAGE_SIZE);
 
     /**
      * @brief Requests config from Opener via BLE
@@ -377,6 +441,37 @@ class NukiOpener : public Nuki::NukiBle {
      */
     Nuki::CmdResult requestAdvancedConfig(AdvancedConfig* retrievedAdvancedConfig);
 
+    /**
+     * @brief Starts a config transaction: until commitConfigTransaction() the config and advanced config
+     * are read from the Opener only once and the config setters (setName(), ...) only change the read copies
+     */
+    void beginConfigTransaction();
+
+    /**
+     * @brief Sends the config and/or advanced config changed since beginConfigTransaction() to the Opener,
+     * one SetConfig and one SetAdvancedConfig at most, and ends the transaction. When sending fails the
+     * transaction stays open with the changes not sent yet, so it can be committed again or aborted
+     */
+    Nuki::CmdResult commitConfigTransaction();
+
+    /**
+     * @brief Ends the config transaction without sending the changes
+     */
+    void abortConfigTransaction();
+
+    /**
+     * @brief Requests state, battery report, config and advanced config from the Opener over one BLE connection.
+     * Pass nullptr for data that is not needed, data is only copied if the corresponding request succeeded.
+     *
+     * @param retrievedOpenerState Nuki api based datatype to store the retrieved state
+     * @param retrievedBatteryReport Nuki api based datatype to store the retrieved battery status
+     * @param retrievedConfig Nuki api based datatype to store the retrieved config
+     * @param retrievedAdvancedConfig Nuki api based datatype to store the retrieved advanced config
+     * @return Nuki::CmdResult::Success if all requests succeeded, else the result of the first failing request
+     */
+    Nuki::CmdResult requestStatus(OpenerState* retrievedOpenerState, BatteryReport* retrievedBatteryReport,
+                                  Config* retrievedConfig, AdvancedConfig* retrievedAdvancedConfig);
+
 
     /**
      * @brief Returns battery critical state parsed from the battery state byte (battery critical byte)
@@ -405,9 +500,14 @@ class NukiOpener : public Nuki::NukiBle {
 
   protected:
     void handleReturnMessage(Command returnCode, unsigned char* data, uint16_t dataLen) override;
+    const Nuki::PayloadSize* findExpectedPayloadSize(const Command returnCode) const override;
+    Nuki::CmdHandle requestStateAsync(Nuki::CmdCallback callback) override;
+    Nuki::CmdResult requestLogPage(const uint32_t startIndex, const uint16_t count, const uint8_t sortOrder) override;
 
 
   private:
+    void createLockAction(Action* action, const LockAction lockAction, const uint32_t nukiAppId, const uint8_t flags,
+                          const char* nameSuffix, const uint8_t nameSuffixLen);
     Nuki::CmdResult setConfig(NewConfig newConfig);
     Nuki::CmdResult setFromConfig(const Config config);
     Nuki::CmdResult setAdvancedConfig(NewAdvancedConfig newAdvancedConfig);
@@ -417,11 +517,14 @@ class NukiOpener : public Nuki::NukiBle {
 
     OpenerState openerState;
     BatteryReport batteryReport;
-    std::list<TimeControlEntry> listOfTimeControlEntries;
-    std::list<LogEntry> listOfLogEntries;
+    EntryBuffer<TimeControlEntry> listOfTimeControlEntries;
+    EntryBuffer<LogEntry> listOfLogEntries;
+    LogEntryCallback logEntryCallback = nullptr;
+    LogEntryCallback logSyncCallback = nullptr;
 
     Config config;
     AdvancedConfig advancedConfig;
+    Nuki::ConfigTransaction<Config, AdvancedConfig> configTransaction;
 
 };
 
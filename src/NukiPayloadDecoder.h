@@ -0,0 +1,108 @@
+#pragma once
+
+/**
+ * @file NukiPayloadDecoder.h
+ * Bounds checked decoding of received payloads into the packed Nuki data types
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * Received payloads are copied into their data type up to the size of the type, the remainder of
+ * the type is zero filled. A payload length outside the range expected for the command (ie a newer
+ * firmware adding fields or an older one missing fields) is counted in the stats.
+ * Only depends on the C library so it can be used on the host as well.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace Nuki {
+
+struct PayloadSize {
+  uint16_t command;
+  uint16_t minSize;
+  uint16_t maxSize;
+};
+
+struct PayloadStats {
+  uint32_t decoded;
+  uint32_t shortPayloads;
+  uint32_t longPayloads;
+  uint16_t lastMismatchCommand;
+  uint16_t lastMismatchLen;
+};
+
+/**
+ * @brief Payload size entry for a command of which the payload is exactly one T
+ */
+template <typename T>
+constexpr PayloadSize payloadSizeOf(const uint16_t command) {
+  return {command, (uint16_t)sizeof(T), (uint16_t)sizeof(T)};
+}
+
+/**
+ * @brief Payload size entry for a command of which older firmware does not send the fields of T from
+ * offset minSize on (the trailing fields with a default value), or of which the last field has a
+ * variable length (ie the data of a log entry)
+ */
+template <typename T>
+constexpr PayloadSize payloadSizeFrom(const uint16_t command, const size_t minSize) {
+  return {command, (uint16_t)minSize, (uint16_t)sizeof(T)};
+}
+
+/**
+ * @brief Returns the expected payload size of a command from a size table
+ *
+ * @param table size table
+ * @param count number of entries in the table
+ * @param command received command
+ * @return the entry, nullptr if the command is not in the table
+ */
+inline const PayloadSize* findPayloadSize(const PayloadSize* table, const size_t count, const uint16_t command) {
+  for (size_t i = 0; i < count; i++) {
+    if (table[i].command == command) {
+      return &table[i];
+    }
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Copies min(dataLen, sizeof(T)) bytes of the payload into target and zero fills the rest
+ *
+ * @param target data type to decode into
+ * @param data received payload
+ * @param dataLen length of the received payload
+ * @param command received command, only used for the stats
+ * @param expected expected payload size, nullptr to expect sizeof(T)
+ * @param stats decode and mismatch counters
+ * @return false if the payload length is outside the expected range
+ */
+template <typename T>
+bool decodePayload(T* target, const uint8_t* data, const uint16_t dataLen, const uint16_t command,
+                   const PayloadSize* expected, PayloadStats* stats) {
+  size_t copyLen = dataLen < sizeof(T) ? dataLen : sizeof(T);
+  memcpy((uint8_t*)target, data, copyLen);
+  memset((uint8_t*)target + copyLen, 0, sizeof(T) - copyLen);
+
+  uint16_t minSize = expected != nullptr ? expected->minSize : sizeof(T);
+  uint16_t maxSize = expected != nullptr ? expected->maxSize : sizeof(T);
+
+  stats->decoded++;
+  if (dataLen >= minSize && dataLen <= maxSize) {
+    return true;
+  }
+
+  if (dataLen < minSize) {
+    stats->shortPayloads++;
+  } else {
+    stats->longPayloads++;
+  }
+  stats->lastMismatchCommand = command;
+  stats->lastMismatchLen = dataLen;
+  return false;
+}
+
+} // namespace Nuki
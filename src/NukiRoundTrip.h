@@ -0,0 +1,86 @@
+#pragma once
+
+/**
+ * @file NukiRoundTrip.h
+ * Sliding window of the round trip times of the protocol steps, with the percentiles the adaptive
+ * timeouts are derived from
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * The window keeps a sorted copy of its samples, so a new sample only moves the values between the
+ * evicted and the new sample and the percentiles are a lookup.
+ * Only depends on the C++ standard library so it can be used on the host as well.
+ *
+ */
+
+#include <stdint.h>
+#include <algorithm>
+
+namespace Nuki {
+
+template <uint8_t Size>
+class RoundTripWindow {
+  public:
+    /**
+     * @brief Adds a round trip time, evicting the oldest one when the window is full
+     *
+     * @param rtt round trip time in ms, saturated at UINT16_MAX
+     */
+    void add(const uint32_t rtt) {
+      uint16_t sample = std::min(rtt, (uint32_t)UINT16_MAX);
+
+      uint8_t pos;
+      if (count < Size) {
+        pos = count;
+        count++;
+      } else {
+        pos = std::lower_bound(sorted, sorted + Size, samples[index]) - sorted;
+      }
+      while (pos > 0 && sorted[pos - 1] > sample) {
+        sorted[pos] = sorted[pos - 1];
+        pos--;
+      }
+      while (pos + 1 < count && sorted[pos + 1] < sample) {
+        sorted[pos] = sorted[pos + 1];
+        pos++;
+      }
+      sorted[pos] = sample;
+
+      samples[index] = sample;
+      index = (index + 1) % Size;
+      p50 = sorted[(count * 50 + 99) / 100 - 1];
+      p99 = sorted[(count * 99 + 99) / 100 - 1];
+    }
+
+    /**
+     * @brief Returns the timeout derived from the p99 round trip time: p99 * factor clamped between
+     * floorMs and ceilingMs
+     */
+    uint32_t timeout(const float factor, const uint16_t floorMs, const uint16_t ceilingMs) const {
+      uint32_t derived = (uint32_t)(p99 * factor);
+      return std::min(std::max(derived, (uint32_t)floorMs), (uint32_t)std::max(floorMs, ceilingMs));
+    }
+
+    uint16_t getCount() const {
+      return count;
+    }
+
+    uint16_t getP50() const {
+      return p50;
+    }
+
+    uint16_t getP99() const {
+      return p99;
+    }
+
+  private:
+    uint16_t samples[Size] = {0};
+    uint16_t sorted[Size] = {0};
+    uint16_t count = 0;
+    uint8_t index = 0;
+    uint16_t p50 = 0;
+    uint16_t p99 = 0;
+};
+
+} // namespace Nuki
@@ -0,0 +1,98 @@
+#pragma once
+
+/**
+ * @file NukiRxQueue.h
+ * Lock free ring buffer handing the received frames from the NimBLE host task to the protocol task
+ *
+ * Created on: 2026
+ * License: GNU GENERAL PUBLIC LICENSE (see LICENSE)
+ *
+ * Single producer / single consumer: only the producer calls reserve() and commit(), only the consumer
+ * calls front() and pop(). A slot is written in place between reserve() and commit(), so a frame is
+ * copied once. The head and tail are free running counters, the size has to be a power of two so the
+ * slot index stays continuous when they wrap. A frame that does not fit is dropped and counted.
+ * Only depends on the C++ standard library, extras/rx_queue_test runs it on the host.
+ *
+ */
+
+#include <stdint.h>
+#include <atomic>
+
+namespace Nuki {
+
+template <typename T, uint32_t Size>
+class RxQueue {
+    static_assert(Size > 0 && (Size & (Size - 1)) == 0, "RxQueue size must be a power of two");
+
+  public:
+    /**
+     * @brief Returns the slot to write the next frame to, nullptr (and counted as dropped) when full
+     */
+    T* reserve() {
+      uint32_t head = this->head.load(std::memory_order_relaxed);
+      if (head - tail.load(std::memory_order_acquire) >= Size) {
+        dropped++;
+        return nullptr;
+      }
+      return &slots[head % Size];
+    }
+
+    /**
+     * @brief Publishes the slot returned by reserve() to the consumer
+     */
+    void commit() {
+      uint32_t head = this->head.load(std::memory_order_relaxed) + 1;
+      this->head.store(head, std::memory_order_release);
+
+      uint32_t depth = head - tail.load(std::memory_order_acquire);
+      if (depth > maxDepth) {
+        maxDepth = depth;
+      }
+    }
+
+    /**
+     * @brief Counts a frame the producer could not queue (ie too large for a slot)
+     */
+    void drop() {
+      dropped++;
+    }
+
+    /**
+     * @brief Returns the oldest frame, nullptr when empty
+     */
+    T* front() {
+      uint32_t tail = this->tail.load(std::memory_order_relaxed);
+      if (tail == head.load(std::memory_order_acquire)) {
+        return nullptr;
+      }
+      return &slots[tail % Size];
+    }
+
+    /**
+     * @brief Releases the frame returned by front() to the producer
+     */
+    void pop() {
+      tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    uint32_t getDepth() const {
+      return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    uint32_t getMaxDepth() const {
+      return maxDepth;
+    }
+
+    uint32_t getDropped() const {
+      return dropped;
+    }
+
+  private:
+    T slots[Size];
+    std::atomic<uint32_t> head{0};
+    std::atomic<uint32_t> tail{0};
+    std::atomic<uint32_t> maxDepth{0};
+    std::atomic<uint32_t> dropped{0};
+};
+
+} // namespace Nuki
@@ -1,7 +1,8 @@
 #include "NukiUtils.h"
 
 #include "sodium/crypto_secretbox.h"
-#include "Crc16.h"
+#include "NukiCrc.h"
+#include "esp_random.h"
 
 
 namespace Nuki {
@@ -93,18 +94,21 @@ int decode(unsigned char* output, unsigned char* input, unsigned long long len,
 }
 
 void generateNonce(unsigned char* hexArray, uint8_t nrOfBytes, bool debug, Print* Log) {
-  randomSeed(millis());
-  for (int i = 0 ; i < nrOfBytes ; i++) {
-    hexArray[i] = random(0, 255);
-  }
+  esp_fill_random(hexArray, nrOfBytes);
   printBuffer((byte*)hexArray, nrOfBytes, false, "Nonce", debug, Log);
 }
 
 unsigned int calculateCrc(uint8_t* data, uint8_t start, uint16_t length) {
-  Crc16 crcObj;
-  crcObj.clearCrc();
-  // CCITT-False:	width=16 poly=0x1021 init=0xffff refin=false refout=false xorout=0x0000 check=0x29b1
-  return crcObj.fastCrc(data, start, length, false, false, 0x1021, 0xffff, 0x0000, 0x8000, 0xffff);
+  //as with Crc16::fastCrc length is the end index, not the number of bytes
+  if (length <= start) {
+    return 0xffff;
+  }
+  #ifdef NUKI_CRC_SLICING_BY_4
+  if (length - start >= NUKI_CRC_SLICING_MIN_LEN) {
+    return crc16CcittFalseSlicing4(&data[start], length - start);
+  }
+  #endif
+  return crc16CcittFalse(&data[start], length - start);
 }
 
 bool crcValid(uint8_t* pData, uint16_t length, bool debug, Print* Log) {